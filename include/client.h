@@ -0,0 +1,169 @@
+#pragma once
+
+#include "core.h"
+#include "log.h"
+#include "protocol.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace bf
+{
+// runs a program on a server started with --serve (see protocol.h) and prints its output as it arrives
+class client
+{
+  public:
+    client(std::string_view socket_path)
+        : socket_path_{socket_path}
+    {
+    }
+
+    client(const client &) = delete;
+    client &operator=(const client &) = delete;
+
+    ~client()
+    {
+        if (fd_ != -1)
+        {
+            close(fd_);
+        }
+    }
+
+    int execute(std::string_view source, std::string_view input, limits lim = {})
+    {
+        auto err = connect();
+        if (err != 0)
+        {
+            return err;
+        }
+
+        // the server may drop the program from its cache between load and run so try twice
+        for (auto attempt = 0; attempt < 2; ++attempt)
+        {
+            uint64_t id{};
+            err = load(source, id);
+            if (err != 0)
+            {
+                return err;
+            }
+
+            auto code = run(id, input, lim);
+            if (code)
+            {
+                return *code;
+            }
+        }
+
+        logger::instance().fatal("server keeps losing the program.");
+        return 1;
+    }
+
+  private:
+    int connect()
+    {
+        sockaddr_un addr{};
+        if (socket_path_.size() >= sizeof(addr.sun_path))
+        {
+            logger::instance().fatal("socket path '{}' is too long.", socket_path_);
+            return 1;
+        }
+
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+
+        fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            logger::instance().fatal("could not connect to '{}': {}", socket_path_, std::strerror(errno));
+            return 1;
+        }
+
+        return 0;
+    }
+
+    int load(std::string_view source, uint64_t &id)
+    {
+        if (!write_frame(fd_, frame_type::load, source))
+        {
+            return lost();
+        }
+
+        auto reply = read_frame(fd_);
+        if (!reply)
+        {
+            return lost();
+        }
+
+        if (reply->type == frame_type::error)
+        {
+            return payload_as<int32_t>(reply->payload).value_or(1); // the server logged the details
+        }
+
+        auto value = payload_as<uint64_t>(reply->payload);
+        if (reply->type != frame_type::id || !value)
+        {
+            return lost();
+        }
+
+        id = *value;
+        return 0;
+    }
+
+    // returns the exit code of the run or nothing if the server does not know the program
+    std::optional<int> run(uint64_t id, std::string_view input, limits lim)
+    {
+        run_header header{id, 0, 0};
+        if (lim.ops != limits{}.ops)
+        {
+            header.max_ops = lim.ops;
+        }
+        if (lim.output != limits{}.output)
+        {
+            header.max_output = lim.output;
+        }
+
+        std::string payload(reinterpret_cast<const char *>(&header), sizeof(header));
+        payload += input;
+
+        if (!write_frame(fd_, frame_type::run, payload))
+        {
+            return lost();
+        }
+
+        while (auto reply = read_frame(fd_))
+        {
+            switch (reply->type)
+            {
+            case frame_type::output:
+                std::fwrite(reply->payload.data(), 1, reply->payload.size(), stdout);
+                std::fflush(stdout);
+                break;
+            case frame_type::exit:
+                return payload_as<int32_t>(reply->payload).value_or(1);
+            case frame_type::unknown:
+                return std::nullopt;
+            default:
+                return lost();
+            }
+        }
+
+        return lost();
+    }
+
+    int lost() const
+    {
+        logger::instance().fatal("connection to '{}' lost.", socket_path_);
+        return 1;
+    }
+
+    std::string socket_path_;
+    int fd_{-1};
+};
+} // namespace bf
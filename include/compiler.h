@@ -0,0 +1,422 @@
+#pragma once
+
+#include "log.h"
+#include "parser.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace bf
+{
+// compiled form of an action. memory ops address the cell at pointer + offset so a basic block like
+// ">+>++<<-" becomes "add [p+1], 1; add [p+2], 2; add [p], -1" without moving the pointer at all.
+// increment carries the amount to add in arg, move_right carries the (signed) distance.
+struct instruction
+{
+    action act;
+    int32_t offset;
+    int64_t arg;
+};
+
+constexpr bool is_block_action(action act)
+{
+    return act == action::increment || act == action::decrement || act == action::move_right ||
+           act == action::move_left;
+}
+
+// input skips the next action on EOF so a block action right after an input stays a separate instruction
+constexpr instruction isolated_instruction(action act)
+{
+    auto cell_op = act == action::increment || act == action::decrement;
+    auto up = act == action::increment || act == action::move_right;
+    return instruction{cell_op ? action::increment : action::move_right, 0, up ? 1 : -1};
+}
+
+// pointer movement of a basic block
+struct block_moves
+{
+    int64_t net;
+    int64_t lowest;  // lowest offset the pointer reaches on the way
+    int64_t highest; // highest offset the pointer reaches on the way
+};
+
+// calls visit(offset, delta) for every + and - of a basic block given as its size and the action at each
+// index (anything that is not +-<> is ignored)
+template <typename At, typename Visit> constexpr block_moves walk_block(size_t size, At &&at, Visit &&visit)
+{
+    block_moves moves{0, 0, 0};
+    auto &offset = moves.net;
+    for (size_t i = 0; i < size; ++i)
+    {
+        switch (at(i))
+        {
+        case action::increment:
+            visit(offset, 1);
+            break;
+        case action::decrement:
+            visit(offset, -1);
+            break;
+        case action::move_right:
+            ++offset;
+            moves.highest = offset > moves.highest ? offset : moves.highest;
+            break;
+        case action::move_left:
+            --offset;
+            moves.lowest = offset < moves.lowest ? offset : moves.lowest;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return moves;
+}
+
+// turns a basic block of +-<> into adds on offsets from the pointer (ascending, zero sums dropped)
+// followed by one net move. adds and the move check bounds at runtime so a block that goes further than
+// any of them without touching a cell there (e.g. "><") also gets a move there and back. that way going
+// out of bounds is noticed just like with single steps.
+// both compiler and static_core use this so they always produce the same code.
+// Sums::each(walk, cb) calls cb(offset, sum) for every offset in ascending order. walk(visit) replays
+// walk_block so it can be done with a map at runtime or by scanning at compile time.
+template <typename Sums, typename At, typename Emit> constexpr void fold_block(size_t size, At &&at, Emit &&emit)
+{
+    auto walk = [&](auto &&visit) { return walk_block(size, at, visit); };
+    auto moves = walk([](int64_t, int64_t) {});
+
+    // offsets the emitted instructions check anyway
+    auto lowest = moves.net < 0 ? moves.net : 0;
+    auto highest = moves.net > 0 ? moves.net : 0;
+
+    Sums::each(walk, [&](int64_t offset, int64_t value) {
+        if (value != 0)
+        {
+            emit(instruction{action::increment, static_cast<int32_t>(offset), value});
+            lowest = offset < lowest ? offset : lowest;
+            highest = offset > highest ? offset : highest;
+        }
+    });
+
+    if (moves.highest > highest)
+    {
+        emit(instruction{action::move_right, 0, moves.highest});
+        emit(instruction{action::move_right, 0, -moves.highest});
+    }
+
+    if (moves.lowest < lowest)
+    {
+        emit(instruction{action::move_right, 0, moves.lowest});
+        emit(instruction{action::move_right, 0, -moves.lowest});
+    }
+
+    if (moves.net != 0)
+    {
+        emit(instruction{action::move_right, 0, moves.net});
+    }
+}
+
+// sibling loop nests that do no I/O, leave the pointer where they started and touch disjoint cells.
+// such nests don't depend on each other so they can run concurrently. the adds and moves between them
+// (counters being set up for the next nest) are allowed as long as they don't touch cells of an earlier
+// nest. then they can all be done before the nests run
+struct nest_group
+{
+    std::vector<std::pair<uint64_t, int64_t>> nests; // loop_start of each nest and its pointer offset
+    std::vector<std::pair<int64_t, int64_t>> adds;   // cell offset and amount of the adds between the nests
+    std::pair<int64_t, int64_t> reach;               // lowest and highest pointer or cell offset used
+    uint64_t end;                                     // loop_end of the last nest
+    uint64_t between;                                 // instructions between the nests
+};
+
+// compiled program. once compiled it is never modified so it can be shared between runs
+struct program
+{
+    std::vector<instruction> tape;
+    std::vector<uint64_t> targets; // matching loop_end for a loop_start and vice versa
+    std::vector<nest_group> groups; // a loop_start with arg n > 0 starts groups[n - 1]
+};
+
+class compiler
+{
+  public:
+    compiler()
+        : program_{std::make_shared<program>()}
+    {
+        program_->tape.reserve(1024); // probably enough for most programs. will grow if needed
+        program_->targets.reserve(1024);
+        loops_.reserve(128); // should be enough depth for most programs
+    }
+
+    // program being compiled. in pipelined mode it's executed while it grows
+    std::shared_ptr<program> result() const { return program_; }
+
+    // set once action::eof was appended
+    bool done() const { return done_; }
+
+    // compiles a whole parsed program (ending in action::eof) including its nest groups.
+    // pipelined mode appends as it goes instead
+    int compile(const std::vector<action> &source)
+    {
+        for (uint64_t cursor = 0; cursor < source.size(); ++cursor)
+        {
+            auto err = append(cursor, source[cursor]);
+            if (err != 0)
+            {
+                return err;
+            }
+        }
+
+        find_parallel_nests();
+        return 0;
+    }
+
+    int append(uint64_t cursor, action act)
+    {
+        auto isolated = std::exchange(after_input_, act == action::input) && is_block_action(act);
+        if (isolated)
+        {
+            emit(isolated_instruction(act));
+            return 0;
+        }
+
+        if (is_block_action(act))
+        {
+            block_.push_back(act);
+            return 0;
+        }
+
+        // anything else ends the basic block
+        flush_block();
+        emit({act, 0, 0});
+
+        auto &targets = program_->targets;
+        auto idx = program_->tape.size() - 1;
+
+        switch (act)
+        {
+        case action::loop_start:
+            loops_.push_back({idx, cursor});
+            break;
+        case action::loop_end: {
+            if (loops_.empty())
+            {
+                logger::instance().fatal("unmatched ']' at {}", cursor);
+                return 127;
+            }
+
+            auto start = loops_.back().first;
+            targets[idx] = start;
+            targets[start] = idx;
+            loops_.pop_back();
+        }
+        break;
+        case action::eof:
+            done_ = true;
+
+            if (!loops_.empty())
+            {
+                logger::instance().fatal("unmatched '[' at {}", loops_.back().second);
+                return 128;
+            }
+            break;
+        default:
+            // not interested at these here
+            break;
+        }
+
+        return 0;
+    }
+
+  private:
+    // finds groups of independent sibling loop nests (see nest_group). only valid once done
+    void find_parallel_nests()
+    {
+        auto &prog = *program_;
+        std::vector<std::optional<std::pair<int64_t, int64_t>>> ranges(prog.tape.size());
+        std::vector<bool> analyzed(prog.tape.size(), false);
+
+        // range of cells and pointer positions a balanced I/O free loop uses relative to its start or nothing
+        std::function<std::optional<std::pair<int64_t, int64_t>>(uint64_t)> range_of = [&](uint64_t start) {
+            if (analyzed[start])
+            {
+                return ranges[start];
+            }
+            analyzed[start] = true;
+
+            int64_t ptr{0};
+            std::pair<int64_t, int64_t> cells{0, 0}; // the loop condition reads the start cell
+            auto touch = [&](int64_t lowest, int64_t highest) {
+                cells.first = std::min(cells.first, lowest);
+                cells.second = std::max(cells.second, highest);
+            };
+
+            for (auto idx = start + 1; idx < prog.targets[start]; ++idx)
+            {
+                auto &ins = prog.tape[idx];
+                switch (ins.act)
+                {
+                case action::increment:
+                    touch(ptr + ins.offset, ptr + ins.offset);
+                    break;
+                case action::move_right:
+                    // every pointer position counts even without a cell access so the group's bounds check
+                    // fails wherever the interpreter would
+                    ptr += ins.arg;
+                    touch(ptr, ptr);
+                    break;
+                case action::loop_start: {
+                    auto inner = range_of(idx);
+                    if (!inner)
+                    {
+                        return ranges[start];
+                    }
+
+                    touch(ptr + inner->first, ptr + inner->second);
+                    idx = prog.targets[idx];
+                }
+                break;
+                case action::start_of_input:
+                    break; // nop
+                default:
+                    return ranges[start]; // I/O or memory dump
+                }
+            }
+
+            if (ptr == 0)
+            {
+                ranges[start] = cells;
+            }
+
+            return ranges[start];
+        };
+
+        // a group needs a real nest. single loops like [-] are over before a thread would start
+        auto is_nest = [&](uint64_t start) {
+            auto end = prog.tape.begin() + prog.targets[start];
+            return std::any_of(prog.tape.begin() + start + 1, end,
+                               [](auto &ins) { return ins.act == action::loop_start; });
+        };
+
+        for (uint64_t idx = 0; idx < prog.tape.size(); ++idx)
+        {
+            if (prog.tape[idx].act != action::loop_start || !range_of(idx))
+            {
+                continue;
+            }
+
+            auto first = *range_of(idx);
+            nest_group group{{{idx, 0}}, {}, first, prog.targets[idx], 0};
+            std::vector<std::pair<int64_t, int64_t>> cells{first}; // cells touched by each nest
+            auto nests = is_nest(idx) ? 1 : 0;
+
+            // adds and moves up to the next loop. only part of the group once that loop is
+            int64_t ptr{0};
+            auto reach = group.reach;
+            std::vector<std::pair<int64_t, int64_t>> adds;
+            uint64_t between{0};
+
+            auto untouched = [&](int64_t lowest, int64_t highest) {
+                return std::all_of(cells.begin(), cells.end(), [&](auto &other) {
+                    return highest < other.first || lowest > other.second;
+                });
+            };
+
+            for (auto next = prog.targets[idx] + 1; next < prog.tape.size(); next = prog.targets[next] + 1)
+            {
+                for (; next < prog.tape.size(); ++next)
+                {
+                    auto &ins = prog.tape[next];
+                    if (ins.act == action::increment && untouched(ptr + ins.offset, ptr + ins.offset))
+                    {
+                        adds.push_back({ptr + ins.offset, ins.arg});
+                        reach = {std::min(reach.first, ptr + ins.offset), std::max(reach.second, ptr + ins.offset)};
+                    }
+                    else if (ins.act == action::move_right)
+                    {
+                        ptr += ins.arg;
+                        reach = {std::min(reach.first, ptr), std::max(reach.second, ptr)};
+                    }
+                    else
+                    {
+                        break;
+                    }
+                    ++between;
+                }
+
+                if (next >= prog.tape.size() || prog.tape[next].act != action::loop_start || !range_of(next))
+                {
+                    break;
+                }
+
+                auto range = *range_of(next);
+                range.first += ptr;
+                range.second += ptr;
+
+                if (!untouched(range.first, range.second))
+                {
+                    break;
+                }
+
+                group.nests.push_back({next, ptr});
+                group.adds = adds;
+                group.reach = {std::min(reach.first, range.first), std::max(reach.second, range.second)};
+                group.end = prog.targets[next];
+                group.between = between;
+                cells.push_back(range);
+                nests += is_nest(next) ? 1 : 0;
+                reach = group.reach;
+            }
+
+            if (group.nests.size() > 1 && nests > 0)
+            {
+                prog.groups.push_back(std::move(group));
+                prog.tape[idx].arg = prog.groups.size();
+            }
+        }
+
+        logger::instance().info("found {} groups of independent loop nests", prog.groups.size());
+    }
+
+    // sums per offset for fold_block
+    struct map_sums
+    {
+        template <typename Walk, typename Each> static void each(Walk &&walk, Each &&cb)
+        {
+            std::map<int64_t, int64_t> sums;
+            walk([&](int64_t offset, int64_t delta) { sums[offset] += delta; });
+
+            for (auto [offset, value] : sums)
+            {
+                cb(offset, value);
+            }
+        }
+    };
+
+    // turns the pending run of +-<> into adds on offsets from the pointer followed by one net move
+    void flush_block()
+    {
+        fold_block<map_sums>(
+            block_.size(), [this](size_t i) { return block_[i]; }, [this](instruction ins) { emit(ins); });
+        block_.clear();
+    }
+
+    void emit(instruction ins)
+    {
+        program_->tape.push_back(ins);
+        program_->targets.push_back(0);
+    }
+
+    std::shared_ptr<program> program_;
+    bool done_{false};
+
+    std::vector<action> block_; // pending +-<> of the current basic block
+    bool after_input_{false};   // previous action was an input
+
+    std::vector<std::pair<uint64_t, uint64_t>> loops_; // unmatched loop starts: tape index and source position
+};
+} // namespace bf
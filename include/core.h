@@ -1,38 +1,89 @@
 #pragma once
 
+#include "compiler.h"
+#include "jit.h"
 #include "memory.h"
 #include "parser.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_pool.h"
 
 #include <fmt/format.h>
 #include <fstream>
 #include <iostream>
-#include <map>
+#include <limits>
+#include <memory>
+#include <numeric>
 
 namespace bf
 {
+// execution limits. mostly useful for programs that come from somewhere else (see server)
+struct limits
+{
+    uint64_t ops{std::numeric_limits<uint64_t>::max()};    // executed instructions
+    uint64_t output{std::numeric_limits<uint64_t>::max()}; // printed bytes
+};
+
+// what a run did. kept per core so concurrent runs (see server) don't share anything
+struct run_counts
+{
+    uint64_t instructions{0}; // executed compiled instructions
+    uint64_t input_bytes{0};
+    uint64_t output_bytes{0};
+};
+
 template <typename T> class core
 {
   public:
     using memory_t = memory<T>;
     using parser_t = parser<T>;
 
-    core(std::string_view file, uint64_t cells, uint64_t start_cell, bool elastic, bool wrapping)
+    core(std::string_view file, uint64_t cells, uint64_t start_cell, bool elastic, bool wrapping,
+         bool pipelined = false, limits lim = {})
         : memory_{cells, start_cell, elastic, wrapping}
-        , parser_{file}
-        , targets_(cells, 0)
+        , parser_{std::make_unique<parser_t>(file)}
+        , compiler_{std::make_unique<compiler>()}
+        , pipelined_{pipelined}
+        , limits_{lim}
+        , input_{std::cin}
+        , output_{std::cout}
+    {
+    }
+
+    // runs an already compiled program on given memory. io is done on the given streams
+    core(std::shared_ptr<const program> prog, memory_t &&mem, std::istream &input, std::ostream &output,
+         limits lim = {})
+        : memory_{std::move(mem)}
+        , program_{std::move(prog)}
+        , pipelined_{false}
+        , limits_{lim}
+        , input_{input}
+        , output_{output}
     {
-        tape_.reserve(1024); // probably enough for most programs. will grow if needed
     }
 
     int execute()
     {
-        auto err = compile();
-        if (err != 0)
+        if (pipelined_)
         {
-            return err;
+            // code is compiled on demand while it runs so it's all measured as run
+            program_ = compiler_->result();
+
+            auto measure = stats::instance().measure(phase::run);
+            return run<true>();
         }
 
-        err = run();
+        if (!program_)
+        {
+            auto err = compile();
+            if (err != 0)
+            {
+                return err;
+            }
+        }
+
+        auto measure = stats::instance().measure(phase::run);
+        auto err = run<false>();
         if (err != 0)
         {
             return err;
@@ -41,119 +92,213 @@ template <typename T> class core
         return 0; // for now assume all good
     }
 
+    const run_counts &counts() const { return counts_; }
+
+    // gives the memory back once done. used to pool memory between runs
+    memory_t take_memory() { return std::move(memory_); }
+
   private:
     int compile()
     {
-        std::vector<uint64_t> loops;
-        loops.reserve(128); // should be enough depth for most programs
+        std::vector<action> source;
+        source.reserve(1024);
 
         // parsing
-        auto err = parser_.parse([&](auto cursor, auto act) {
-            auto ret{0};
-            tape_.push_back(act);
-
-            switch (act)
-            {
-            case action::loop_start:
-                loops.push_back(cursor);
-                break;
-            case action::loop_end: {
-                if (loops.empty())
-                {
-                    logger::instance().fatal("unmatched ']' at {}", cursor);
-                    ret = 127;
-                    break;
-                }
-
-                auto idx = loops.back();
-                targets_[cursor] = idx;
-                targets_[idx] = cursor;
-                loops.pop_back();
-            }
-            break;
-            default:
-                // not interested at these here
-                break;
-            }
-
-            return ret;
-        });
+        {
+            auto measure = stats::instance().measure(phase::parse);
+            parser_->parse([&](auto, auto act) {
+                source.push_back(act);
+                return 0;
+            });
+        }
 
-        // check if parsing failed with some error
+        auto measure = stats::instance().measure(phase::compile);
+        auto err = compiler_->compile(source);
         if (err != 0)
         {
             return err;
         }
 
-        if (!loops.empty())
+        program_ = compiler_->result();
+        return 0;
+    }
+
+    // compiles more code until pred is satisfied or there is nothing left to read.
+    // this is only used in pipelined mode where execution can catch up with the parser.
+    template <typename Pred> int compile_until(Pred pred)
+    {
+        if (compiler_->done() || pred())
         {
-            logger::instance().fatal("unmatched '[' at {}", loops.back());
-            return 128;
+            return 0;
+        }
+
+        // whatever was printed so far should be visible while we wait for more code
+        output_.flush();
+
+        while (!compiler_->done() && !pred())
+        {
+            auto err = compiler_->append(parsed_++, parser_->next_action());
+            if (err != 0)
+            {
+                return err;
+            }
         }
 
         return 0;
     }
 
-    int run()
+    template <bool Pipelined> int run()
     {
-        for (auto cursor = 0; cursor < tape_.size(); ++cursor)
+        // references to the vectors themselves stay valid while pipelined mode appends to them
+        auto &tape = program_->tape;
+        auto &targets = program_->targets;
+
+        uint64_t executed{0};
+        uint64_t input_bytes{0};
+        uint64_t output_bytes{0};
+
+        // locals so cell writes (char aliases everything) don't force reloading them
+        auto const max_ops = limits_.ops;
+        auto const max_output = limits_.output;
+
+        // op limits and step logging need every instruction to go through the loop below
+        auto const grouping = !Pipelined && max_ops == std::numeric_limits<uint64_t>::max() &&
+                              !logger::instance().enabled() && !program_->groups.empty();
+        if (grouping)
         {
-            switch (tape_.at(cursor))
+            hot_groups_.assign(program_->groups.size(), false);
+        }
+
+        // loops start out interpreted and are compiled to native code once they ran HotLoop iterations
+        auto const tiering = jit<T>::Supported && !Pipelined && max_ops == std::numeric_limits<uint64_t>::max() &&
+                             !logger::instance().enabled();
+        if (tiering)
+        {
+            heat_.assign(tape.size(), 0);
+        }
+
+        auto finish = [&](int err) {
+            counts_ = run_counts{executed, input_bytes, output_bytes};
+            return err;
+        };
+
+        for (uint64_t cursor = 0;; ++cursor)
+        {
+            if constexpr (Pipelined)
+            {
+                auto err = compile_until([&] { return cursor < tape.size(); });
+                if (err != 0)
+                {
+                    return finish(err);
+                }
+            }
+
+            if (cursor >= tape.size())
+            {
+                break;
+            }
+
+            ++executed;
+
+            auto &ins = tape[cursor];
+            switch (ins.act)
             {
             case action::loop_start:
+                if (grouping && ins.arg != 0 && run_group(ins.arg - 1, executed))
+                {
+                    cursor = program_->groups[ins.arg - 1].end;
+                    break;
+                }
+
+                if (tiering && heat_[cursor] >= HotLoop && run_native(cursor, executed))
+                {
+                    break;
+                }
+
                 if (memory_.is_zero())
                 {
-                    cursor = targets_.at(cursor);
+                    if constexpr (Pipelined)
+                    {
+                        // the only place we have to wait for code: the matching ']' is not read yet.
+                        // a loop_start never targets index 0 so that marks an unresolved jump.
+                        auto err = compile_until([&] { return targets[cursor] != 0; });
+                        if (err != 0)
+                        {
+                            return finish(err);
+                        }
+                    }
+
+                    cursor = targets[cursor];
                 }
                 break;
             case action::loop_end:
                 if (!memory_.is_zero())
                 {
-                    cursor = targets_.at(cursor);
+                    if (executed > max_ops)
+                    {
+                        logger::instance().fatal("operation limit exceeded.");
+                        return finish(132);
+                    }
+
+                    cursor = targets[cursor];
+
+                    // the next iteration runs natively if this made the loop hot
+                    if (tiering && ++heat_[cursor] >= HotLoop && run_native(cursor, executed))
+                    {
+                        break;
+                    }
                 }
                 break;
-            case action::increment:
-                memory_.inc();
-                break;
-            case action::decrement:
-                memory_.dec();
-                break;
-            case action::move_left: {
-                auto err = memory_.left();
+            case action::increment: {
+                auto err = memory_.add(ins.arg, ins.offset);
                 if (err != 0)
                 {
-                    return err;
+                    return finish(err);
                 }
             }
             break;
             case action::move_right: {
-                auto err = memory_.right();
+                auto err = memory_.move(ins.arg);
                 if (err != 0)
                 {
-                    return err;
+                    return finish(err);
                 }
             }
             break;
             case action::output: {
-                // only print \n if it's a 10 (bf way)
-                auto c = memory_.read();
-                if (c == T(10))
+                if (output_bytes >= max_output)
                 {
-                    fmt::print("\n");
+                    logger::instance().fatal("output limit exceeded.");
+                    return finish(133);
                 }
-                else
+
+                // 10 is the bf way to print \n so it goes out as is
+                if (!output_.put(memory_.read()))
                 {
-                    fmt::print("{}", c);
+                    // nobody is reading anymore (like a client that left the server). no point in going on
+                    logger::instance().fatal("output could not be written.");
+                    return finish(134);
                 }
+                ++output_bytes;
             }
             break;
             case action::input: {
                 char c{};
 
-                std::cin.clear();
-                std::cin.get(c);
+                if constexpr (Pipelined)
+                {
+                    // stdin still holds code up to '!' so read all of it before touching the data
+                    auto err = compile_until([] { return false; });
+                    if (err != 0)
+                    {
+                        return finish(err);
+                    }
+                }
 
-                if (std::cin.fail())
+                input_.clear();
+                input_.get(c);
+
+                if (input_.fail())
                 {
                     logger::instance().info("EOF received");
                     ++cursor; // skip input
@@ -161,6 +306,8 @@ template <typename T> class core
                     continue;
                 }
 
+                ++input_bytes;
+
                 if (c == '\n' || c == '\r')
                 {
                     memory_.write(T{10}); // 10 is bf way to write \n
@@ -172,7 +319,14 @@ template <typename T> class core
             }
             break;
             case action::memory_dump:
-                memory_.dump();
+                if (snapshots::instance().enabled())
+                {
+                    snapshots::instance().take(memory_);
+                }
+                else
+                {
+                    memory_.dump(output_);
+                }
                 break;
             default:
                 // nop
@@ -180,13 +334,148 @@ template <typename T> class core
             }
         }
 
-        return 0;
+        return finish(0);
+    }
+
+    // runs a group of independent loop nests. false if it can't be shown to stay in bounds
+    bool run_group(uint64_t idx, uint64_t &executed)
+    {
+        auto &group = program_->groups[idx];
+        auto entry = static_cast<int64_t>(memory_.position());
+        auto capacity = static_cast<int64_t>(memory_.capacity());
+
+        if (entry + group.reach.first < 0 || entry + group.reach.second >= capacity)
+        {
+            return false; // would wrap, grow or fail somewhere. let the interpreter handle it
+        }
+
+        // the adds between the nests don't touch cells of the nests before them so they can go first
+        auto cells = memory_.data();
+        for (auto [offset, amount] : group.adds)
+        {
+            cells[entry + offset] += static_cast<T>(amount);
+        }
+
+        uint64_t total{0};
+
+        if (!hot_groups_[idx])
+        {
+            // threads only pay off for long running nests so the first run is used to find out
+            for (auto [start, offset] : group.nests)
+            {
+                total += run_nest(start, cells, entry + offset);
+            }
+        }
+        else
+        {
+            std::vector<uint64_t> ops(group.nests.size(), 0);
+            std::vector<std::function<void()>> tasks;
+            for (auto i = 0u; i < group.nests.size(); ++i)
+            {
+                tasks.push_back([&, i] {
+                    auto [start, offset] = group.nests[i];
+                    ops[i] = run_nest(start, cells, entry + offset);
+                });
+            }
+
+            thread_pool::instance().run_all(tasks);
+            total = std::accumulate(ops.begin(), ops.end(), uint64_t{0});
+        }
+
+        hot_groups_[idx] = total >= ParallelThreshold;
+        executed += total - 1 + group.between; // the first '[' was counted before coming here
+
+        // nests leave the pointer where they started so it ends up at the start of the last one
+        memory_.move(group.nests.back().second);
+        return true;
     }
 
+    // runs one nest of a group without bounds checks and returns the number of executed instructions
+    uint64_t run_nest(uint64_t start, T *cells, uint64_t ptr) const
+    {
+        auto &tape = program_->tape;
+        auto &targets = program_->targets;
+        uint64_t executed{0};
+
+        for (auto cursor = start; cursor <= targets[start]; ++cursor)
+        {
+            ++executed;
+
+            auto &ins = tape[cursor];
+            switch (ins.act)
+            {
+            case action::loop_start:
+                if (cells[ptr] == 0)
+                {
+                    cursor = targets[cursor];
+                }
+                break;
+            case action::loop_end:
+                if (cells[ptr] != 0)
+                {
+                    cursor = targets[cursor];
+                }
+                break;
+            case action::increment:
+                cells[ptr + ins.offset] += static_cast<T>(ins.arg);
+                break;
+            case action::move_right:
+                ptr += ins.arg;
+                break;
+            default:
+                // nop. nests have no I/O
+                break;
+            }
+        }
+
+        return executed;
+    }
+
+    // runs the loop at cursor natively if it can be compiled and the pointer is where it can run unchecked.
+    // cursor is left on the instruction before the one the interpreter continues with
+    bool run_native(uint64_t &cursor, uint64_t &executed)
+    {
+        auto loop = jit_.get(*program_, cursor);
+        if (loop == nullptr)
+        {
+            return false;
+        }
+
+        // the pointer may go anywhere in [low, high] without any cell the loop touches leaving memory
+        auto position = static_cast<int64_t>(memory_.position());
+        auto low = -loop->lowest;
+        auto high = static_cast<int64_t>(memory_.capacity()) - 1 - loop->highest;
+        if (position < low || position > high)
+        {
+            return false;
+        }
+
+        auto cells = memory_.data();
+        auto cell = cells + position;
+        cursor = loop->run(&cell, cells + low, cells + high, &executed) - 1;
+
+        memory_.move(cell - cells - position); // stays in bounds
+        return true;
+    }
+
+    static constexpr uint64_t ParallelThreshold = 1 << 16; // executed instructions
+    static constexpr uint32_t HotLoop = 1000;              // iterations before a loop gets compiled
+
     memory_t memory_;
-    parser_t parser_;
+    std::unique_ptr<parser_t> parser_;     // these two are not set when running a precompiled program
+    std::unique_ptr<compiler> compiler_;
+    std::shared_ptr<const program> program_;
+
+    bool pipelined_;     // run code as it arrives instead of compiling everything first
+    uint64_t parsed_{0}; // actions read so far in pipelined mode
+    limits limits_;
+    run_counts counts_{};
+
+    std::istream &input_;
+    std::ostream &output_;
 
-    std::vector<uint64_t> targets_;
-    std::vector<action> tape_;
+    std::vector<bool> hot_groups_; // nest groups that run long enough to be worth spreading over threads
+    std::vector<uint32_t> heat_;   // iterations of each loop by loop_start index
+    jit<T> jit_;
 }; // namespace bf
 } // namespace bf
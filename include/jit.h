@@ -0,0 +1,365 @@
+#pragma once
+
+#include "compiler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define BF_JIT_SUPPORTED 1
+#else
+#define BF_JIT_SUPPORTED 0
+#endif
+
+namespace bf
+{
+// compiles single hot loops of a program to native x86-64 code. loops that do I/O or memory dumps stay
+// in the interpreter. on other platforms nothing is ever compiled.
+//
+// native code runs the loop from its '[' check and returns the index of the instruction the interpreter
+// continues with. that is the instruction after ']' or a move that would leave [low, high], the range
+// of pointers for which every cell the loop touches is inside memory. the interpreter then does that
+// move itself so growing, wrapping and errors work as usual. executed instructions are counted exactly
+// like the interpreter counts them.
+template <typename T> class jit
+{
+  public:
+    static constexpr bool Supported = BF_JIT_SUPPORTED;
+
+    using native_fn = uint64_t (*)(T **cell, T *low, T *high, uint64_t *executed);
+
+    struct native_loop
+    {
+        native_fn run;
+        int64_t lowest;  // lowest cell offset from the pointer the loop touches
+        int64_t highest; // highest cell offset from the pointer the loop touches
+    };
+
+    // native code for the loop at given loop_start. compiled on first request, nullptr if not possible
+    const native_loop *get(const program &prog, uint64_t start)
+    {
+        if (entries_.size() != prog.tape.size())
+        {
+            entries_.resize(prog.tape.size());
+        }
+
+        auto &entry = entries_[start];
+        if (!entry.tried)
+        {
+            entry.tried = true;
+            entry.compiled = compile(prog, start, entry.loop);
+        }
+
+        return entry.compiled ? &entry.loop : nullptr;
+    }
+
+  private:
+    struct entry
+    {
+        bool tried{false};
+        bool compiled{false};
+        native_loop loop{};
+    };
+
+#if BF_JIT_SUPPORTED
+    struct code_deleter
+    {
+        size_t size;
+        void operator()(void *code) const { munmap(code, size); }
+    };
+
+    // machine code of one loop while it's being generated
+    class assembler
+    {
+      public:
+        assembler(const program &prog, uint64_t root)
+            : prog_{prog}
+            , root_{root}
+        {
+        }
+
+        bool assemble()
+        {
+            // callee saved registers we use: rbx is the cell pointer, r12/r13 the bounds,
+            // r14 where the cell pointer goes back to and r15 where the counter (r8) goes back to
+            bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbx, r12-r15
+            bytes({0x49, 0x89, 0xfe});                                     // mov r14, rdi
+            bytes({0x48, 0x8b, 0x1f});                                     // mov rbx, [rdi]
+            bytes({0x49, 0x89, 0xf4});                                     // mov r12, rsi
+            bytes({0x49, 0x89, 0xd5});                                     // mov r13, rdx
+            bytes({0x49, 0x89, 0xcf});                                     // mov r15, rcx
+            bytes({0x4c, 0x8b, 0x01});                                     // mov r8, [rcx]
+
+            if (!loop(root_))
+            {
+                return false;
+            }
+
+            bytes({0x48, 0xb8}); // mov rax, imm64
+            value(prog_.targets[root_] + 1);
+
+            auto exit = code_.size();
+            bytes({0x49, 0x89, 0x1e});                                     // mov [r14], rbx
+            bytes({0x4d, 0x89, 0x07});                                     // mov [r15], r8
+            bytes({0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b}); // pop r15-r12, rbx
+            bytes({0xc3});                                                 // ret
+
+            // moves leaving the bounds exit here. the interpreter redoes what was counted in advance
+            for (auto [at, cursor] : bailouts_)
+            {
+                patch(at, code_.size());
+                bytes({0x49, 0x81, 0xe8}); // sub r8, imm32
+                value(static_cast<int32_t>(counted_ahead(cursor)));
+                bytes({0x48, 0xb8}); // mov rax, imm64
+                value(cursor);
+                jump(0xe9, exit); // jmp
+            }
+
+            return true;
+        }
+
+        const std::vector<uint8_t> &code() const { return code_; }
+        int64_t lowest() const { return lowest_; }
+        int64_t highest() const { return highest_; }
+
+      private:
+        bool loop(uint64_t start)
+        {
+            auto end = prog_.targets[start];
+
+            compare_zero();
+            auto skip = jump(0x0f84, 0); // je past the loop
+            auto top = code_.size();
+
+            // every iteration runs the instructions on this level and the ']' once
+            int64_t cost{1};
+            for (auto idx = start + 1; idx < end; ++idx)
+            {
+                ++cost;
+                if (prog_.tape[idx].act == action::loop_start)
+                {
+                    idx = prog_.targets[idx];
+                }
+            }
+
+            if (cost > std::numeric_limits<int32_t>::max())
+            {
+                return false;
+            }
+
+            bytes({0x49, 0x81, 0xc0}); // add r8, imm32
+            value(static_cast<int32_t>(cost));
+
+            for (auto idx = start + 1; idx < end; ++idx)
+            {
+                auto &ins = prog_.tape[idx];
+                switch (ins.act)
+                {
+                case action::increment:
+                    if (!add(ins.offset, ins.arg))
+                    {
+                        return false;
+                    }
+                    break;
+                case action::move_right:
+                    if (!move(idx, ins.arg))
+                    {
+                        return false;
+                    }
+                    break;
+                case action::loop_start:
+                    if (!loop(idx))
+                    {
+                        return false;
+                    }
+                    idx = prog_.targets[idx];
+                    break;
+                case action::start_of_input:
+                    break; // nop
+                default:
+                    return false; // I/O and memory dumps need the interpreter
+                }
+            }
+
+            compare_zero();
+            jump(0x0f85, top); // jne back to the body
+            patch(skip, code_.size());
+            return true;
+        }
+
+        // cmp T [rbx], 0
+        void compare_zero()
+        {
+            prefix();
+            bytes({sizeof(T) == 1 ? uint8_t{0x80} : uint8_t{0x83}, 0x3b, 0x00});
+        }
+
+        // add T [rbx + offset * sizeof(T)], value
+        bool add(int64_t offset, int64_t amount)
+        {
+            auto disp = offset * static_cast<int64_t>(sizeof(T));
+            if (disp < std::numeric_limits<int32_t>::min() || disp > std::numeric_limits<int32_t>::max())
+            {
+                return false;
+            }
+
+            lowest_ = std::min(lowest_, offset);
+            highest_ = std::max(highest_, offset);
+
+            if constexpr (sizeof(T) == 8)
+            {
+                bytes({0x48, 0xb8}); // mov rax, imm64
+                value(amount);
+                bytes({0x48, 0x01, 0x83}); // add [rbx + disp32], rax
+                value(static_cast<int32_t>(disp));
+            }
+            else
+            {
+                prefix();
+                bytes({sizeof(T) == 1 ? uint8_t{0x80} : uint8_t{0x81}, 0x83}); // add [rbx + disp32], imm
+                value(static_cast<int32_t>(disp));
+                value(static_cast<T>(amount));
+            }
+
+            return true;
+        }
+
+        // moves the cell pointer unless it leaves the bounds. then the interpreter continues at cursor
+        bool move(uint64_t cursor, int64_t distance)
+        {
+            auto disp = distance * static_cast<int64_t>(sizeof(T));
+            if (disp < std::numeric_limits<int32_t>::min() || disp > std::numeric_limits<int32_t>::max())
+            {
+                return false;
+            }
+
+            bytes({0x48, 0x8d, 0x83}); // lea rax, [rbx + disp32]
+            value(static_cast<int32_t>(disp));
+            bytes({0x4c, 0x39, 0xe0}); // cmp rax, r12
+            bailouts_.push_back({jump(0x0f82, 0), cursor}); // jb
+            bytes({0x4c, 0x39, 0xe8}); // cmp rax, r13
+            bailouts_.push_back({jump(0x0f87, 0), cursor}); // ja
+            bytes({0x48, 0x89, 0xc3}); // mov rbx, rax
+            return true;
+        }
+
+        // instructions from cursor on that the iterations running at cursor already counted up front
+        uint64_t counted_ahead(uint64_t cursor) const
+        {
+            uint64_t count{0};
+            uint64_t depth{0}; // loops entered after cursor count for themselves
+            for (auto idx = cursor; idx <= prog_.targets[root_]; ++idx)
+            {
+                auto act = prog_.tape[idx].act;
+                if (act == action::loop_end && depth > 0)
+                {
+                    --depth;
+                    continue;
+                }
+
+                count += depth == 0 ? 1 : 0;
+                depth += act == action::loop_start ? 1 : 0;
+            }
+
+            return count;
+        }
+
+        // emits a jump (one byte opcode or 0x0f xx) with a rel32 to target and returns where the rel32 is
+        size_t jump(uint16_t opcode, size_t target)
+        {
+            if (opcode > 0xff)
+            {
+                bytes({static_cast<uint8_t>(opcode >> 8)});
+            }
+            bytes({static_cast<uint8_t>(opcode & 0xff)});
+
+            auto at = code_.size();
+            value(int32_t{0});
+            patch(at, target);
+            return at;
+        }
+
+        void patch(size_t at, size_t target)
+        {
+            auto rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+            std::memcpy(code_.data() + at, &rel, sizeof(rel));
+        }
+
+        // operand size prefix for the cell size
+        void prefix()
+        {
+            if constexpr (sizeof(T) == 2)
+            {
+                bytes({0x66});
+            }
+            else if constexpr (sizeof(T) == 8)
+            {
+                bytes({0x48});
+            }
+        }
+
+        void bytes(std::initializer_list<uint8_t> data) { code_.insert(code_.end(), data); }
+
+        template <typename V> void value(V v)
+        {
+            auto at = code_.size();
+            code_.resize(at + sizeof(v));
+            std::memcpy(code_.data() + at, &v, sizeof(v));
+        }
+
+        const program &prog_;
+        uint64_t root_;
+
+        std::vector<uint8_t> code_;
+        std::vector<std::pair<size_t, uint64_t>> bailouts_; // rel32 to patch and cursor to continue at
+        int64_t lowest_{0};                                   // the loop condition reads offset 0
+        int64_t highest_{0};
+    };
+
+    bool compile(const program &prog, uint64_t start, native_loop &loop)
+    {
+        assembler as{prog, start};
+        if (!as.assemble())
+        {
+            return false;
+        }
+
+        auto &code = as.code();
+        auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        auto size = (code.size() + page - 1) / page * page;
+
+        auto mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+        {
+            return false;
+        }
+
+        std::unique_ptr<void, code_deleter> region{mem, code_deleter{size}};
+        std::memcpy(mem, code.data(), code.size());
+        if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0)
+        {
+            return false;
+        }
+
+        loop = native_loop{reinterpret_cast<native_fn>(mem), as.lowest(), as.highest()};
+        regions_.push_back(std::move(region));
+        return true;
+    }
+
+    std::vector<std::unique_ptr<void, code_deleter>> regions_;
+#else
+    bool compile(const program &, uint64_t, native_loop &) { return false; }
+#endif
+
+    std::vector<entry> entries_; // by loop_start index
+};
+} // namespace bf
+
+#undef BF_JIT_SUPPORTED
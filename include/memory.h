@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <utility>
 #include <vector>
 
 #include "log.h"
@@ -15,9 +16,13 @@ template <typename T> class memory
   public:
     using cell_t = T;
 
+    static constexpr uint64_t WindowSize = 256; // most cells a memory dump shows
+
     memory(uint64_t cells, uint64_t start_cell = 0, bool elastic = true, bool wrapping = true)
         : cell_idx_{start_cell}
         , capacity_{cells}
+        , cells_{cells}
+        , start_cell_{start_cell}
         , elastic_{elastic}
         , wrapping_{wrapping}
         , model_{}
@@ -25,81 +30,82 @@ template <typename T> class memory
         allocate(cells);
     }
 
-    void inc() noexcept
-    {
-        ++model_[cell_idx_];
-        debug_log('+');
-    }
-
-    void dec() noexcept
+    // brings memory back to the state right after construction without reallocating
+    void reset()
     {
-        --model_[cell_idx_];
-        debug_log('-');
+        cell_idx_ = start_cell_;
+        capacity_ = cells_;
+        model_.assign(capacity_, T{});
     }
 
-    int right()
+    // adds value to the cell at pointer + offset
+    int add(int64_t value, int64_t offset = 0)
     {
-        auto orig_cell{cell_idx_};
-
-        if (++cell_idx_ >= capacity_)
+        uint64_t idx{};
+        auto err = locate(offset, idx);
+        if (err != 0)
         {
-            if (elastic_)
-            {
-                allocate(capacity_ * 2);
-            }
-            else
-            {
-                logger::instance().fatal("out of bounds.");
-                return 130;
-            }
+            return err;
         }
 
-        debug_log('>', orig_cell);
+        model_[idx] += static_cast<T>(value);
+        debug_log(value > 0 ? '+' : '-', idx);
         return 0;
     }
 
-    int left()
+    // moves the pointer by distance cells in one go. negative distance moves left
+    int move(int64_t distance)
     {
         auto orig_cell{cell_idx_};
 
-        // wrap around if needed
-        if (--cell_idx_ < 0)
+        auto err = locate(distance, cell_idx_);
+        if (err != 0)
         {
-            if (wrapping_)
-            {
-                cell_idx_ = capacity_ - 1;
-            }
-            else
-            {
-                logger::instance().fatal("negative out of bounds.");
-                return 131;
-            }
+            return err;
         }
 
-        debug_log('<', orig_cell);
+        debug_log(distance > 0 ? '>' : '<', orig_cell, cell_idx_);
         return 0;
     }
 
+    // raw access for code that checked the bounds of everything it touches up front
+    cell_t *data() noexcept { return model_.data(); }
+    const cell_t *data() const noexcept { return model_.data(); }
+    uint64_t position() const noexcept { return cell_idx_; }
+    uint64_t capacity() const noexcept { return capacity_; }
+
     bool is_zero() const noexcept { return model_[cell_idx_] == 0; }
 
     char read() const noexcept
     {
-        debug_log('.');
+        debug_log('.', cell_idx_);
         return static_cast<char>(model_[cell_idx_]);
     }
 
     void write(char value) noexcept
     {
         model_[cell_idx_] = T(value);
-        debug_log(',');
+        debug_log(',', cell_idx_);
     }
 
-    void dump() const
+    // cells around the pointer that a memory dump shows: first cell and number of cells
+    std::pair<uint64_t, uint64_t> window() const noexcept
     {
-        auto distance = 128;                                                  // total cells to show in dump
-        auto from_cell = std::max(0, static_cast<int>(cell_idx_ - distance)); // find cell to start from
-        auto to_cell = from_cell + distance * 2;                              // find cell to dump till
+        constexpr uint64_t distance = WindowSize / 2;                     // cells to show on each side
+        auto from_cell = cell_idx_ > distance ? cell_idx_ - distance : 0; // find cell to start from
+        auto to_cell = std::min(from_cell + distance * 2, capacity_);     // find cell to dump till
+        return {from_cell, to_cell - from_cell};
+    }
+
+    void dump(std::ostream &out) const
+    {
+        auto [from_cell, count] = window();
+        render(out, model_.data() + from_cell, from_cell, count, cell_idx_);
+    }
 
+    // prints count cells starting at cell index first as hex and readable characters. cursor is highlighted
+    static void render(std::ostream &out, const cell_t *cells, uint64_t first, uint64_t count, uint64_t cursor)
+    {
         // adjust amount of cells shown per row depending on how wide the hex will be
         auto cells_per_row = 8;
         if constexpr (std::is_same<T, int8_t>())
@@ -113,17 +119,19 @@ template <typename T> class memory
 
         auto separator_at = cells_per_row / 2 - 1; // place extra separator in the middle
 
-        std::cout << std::endl; // make some space on the screen
+        out << std::endl; // make some space on the screen
 
         std::stringstream dump_ss;
         std::stringstream content_ss;
         auto column = 0;
 
-        for (auto cell = from_cell; cell < to_cell; ++cell)
+        for (auto cell = first; cell < first + count; ++cell)
         {
+            auto value = cells[cell - first];
+
             // add content as character
-            char ch = util::to_readable(model_[cell]);
-            if (cell == cell_idx_)
+            char ch = util::to_readable(value);
+            if (cell == cursor)
             {
                 content_ss << util::bold_underline(ch);
             }
@@ -139,13 +147,13 @@ template <typename T> class memory
             }
 
             dump_ss << " ";
-            if (cell == cell_idx_)
+            if (cell == cursor)
             {
-                dump_ss << util::bold_underline(util::hex(model_[cell]));
+                dump_ss << util::bold_underline(util::hex(value));
             }
             else
             {
-                dump_ss << util::hex(model_[cell]);
+                dump_ss << util::hex(value);
             }
 
             if (column == separator_at)
@@ -170,28 +178,64 @@ template <typename T> class memory
 
         // dump the last bit
         dump_ss << std::endl;
-        std::cout << dump_ss.str();
+        out << dump_ss.str();
     }
 
   private:
-    void debug_log(char op) const
+    // finds the cell at pointer + offset. grows or wraps memory the same way single steps would
+    int locate(int64_t offset, uint64_t &idx)
+    {
+        auto cell = cell_idx_ + offset;
+        if (cell < capacity_)
+        {
+            idx = cell;
+            return 0; // fast path. negative results wrap to huge unsigned values and miss it too
+        }
+
+        auto target = static_cast<int64_t>(cell_idx_) + offset;
+        if (target < 0)
+        {
+            if (!wrapping_)
+            {
+                logger::instance().fatal("negative out of bounds.");
+                return 131;
+            }
+
+            auto capacity = static_cast<int64_t>(capacity_);
+            target = (target % capacity + capacity) % capacity;
+        }
+        else if (elastic_)
+        {
+            allocate(std::max(capacity_ * 2, static_cast<uint64_t>(target) + 1));
+        }
+        else
+        {
+            logger::instance().fatal("out of bounds.");
+            return 130;
+        }
+
+        idx = target;
+        return 0;
+    }
+
+    void debug_log(char op, uint64_t idx) const
     {
         if (EnableLog)
         {
-            logger::instance().info("{} [{}] = {} (0x{})", op, cell_idx_, static_cast<int>(model_[cell_idx_]),
-                                    util::hex(static_cast<int>(model_[cell_idx_])).c_str());
+            logger::instance().info("{} [{}] = {} (0x{})", op, idx, static_cast<int>(model_[idx]),
+                                    util::hex(static_cast<int>(model_[idx])).c_str());
         }
     }
 
-    void debug_log(char op, int idx) const
+    void debug_log(char op, uint64_t from, uint64_t to) const
     {
         if (EnableLog)
         {
-            logger::instance().info("{} [{}]=>[{}]", op, idx, cell_idx_);
+            logger::instance().info("{} [{}]=>[{}]", op, from, to);
         }
     }
 
-    void allocate(int cells)
+    void allocate(uint64_t cells)
     {
         capacity_ = cells;
         model_.resize(capacity_, T{});
@@ -200,6 +244,9 @@ template <typename T> class memory
     uint64_t cell_idx_; // current cell ptr
     uint64_t capacity_; // initial capacity. this is used to wrap around
 
+    uint64_t cells_;      // capacity and
+    uint64_t start_cell_; // start cell as given at construction. used by reset
+
     bool elastic_;  // if we wanna allocate infinite space dynamically
     bool wrapping_; // if we wanna wrap around on negative
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <optional>
@@ -37,10 +38,42 @@ enum class action : char
     invalid = -1
 };
 
+// maps a single character of code to its action. constexpr so compile time code can use it too
+constexpr action to_action(char c)
+{
+    switch (c)
+    {
+    case '.':
+        return action::output;
+    case ',':
+        return action::input;
+    case '[':
+        return action::loop_start;
+    case ']':
+        return action::loop_end;
+    case '<':
+        return action::move_left;
+    case '>':
+        return action::move_right;
+    case '+':
+        return action::increment;
+    case '-':
+        return action::decrement;
+    case '!':
+        return action::start_of_input;
+    case '#':
+        return action::memory_dump;
+    default:
+        return action::invalid;
+    }
+}
+
 template <typename T> class parser
 {
   public:
     parser(std::string_view file)
+        : source_{&std::cin}
+        , separated_input_{file.empty()}
     {
         if (!file.empty())
         {
@@ -50,9 +83,18 @@ template <typename T> class parser
                 logger::instance().fatal("input file '{}' could not be read.", file.data());
                 std::exit(-1);
             }
+
+            source_ = file_stream_.get();
         }
     }
 
+    // reads code only from given stream. '!' has no special meaning here
+    parser(std::istream &source)
+        : source_{&source}
+        , separated_input_{false}
+    {
+    }
+
     int parse(std::function<int(unsigned int, action)> cb)
     {
         auto cursor{0};
@@ -60,26 +102,38 @@ template <typename T> class parser
 
         do
         {
-            act = parse_action(next());
-            if (!file_stream_ && act == action::start_of_input)
-            {
-                return cb(cursor, action::eof);
-            }
+            act = next_action();
 
-            if (act != action::invalid)
+            auto err = cb(cursor, act);
+            if (err != 0)
             {
-                auto err = cb(cursor, act);
-                if (err != 0)
-                {
-                    return err;
-                }
-                ++cursor;
+                return err;
             }
+            ++cursor;
         } while (act != action::eof);
 
         return 0;
     }
 
+    // reads until the next meaningful action. blocks if the input has nothing to offer yet.
+    // once action::eof is returned this must not be called again as the rest of stdin is program data.
+    action next_action()
+    {
+        auto act{action::invalid};
+
+        do
+        {
+            act = parse_action(next());
+        } while (act == action::invalid);
+
+        if (separated_input_ && act == action::start_of_input)
+        {
+            return action::eof;
+        }
+
+        return act;
+    }
+
   private:
     action parse_action(std::optional<char> c) const
     {
@@ -88,57 +142,29 @@ template <typename T> class parser
             return action::eof;
         }
 
-        switch (*c)
-        {
-        case '.':
-            return action::output;
-        case ',':
-            return action::input;
-        case '[':
-            return action::loop_start;
-        case ']':
-            return action::loop_end;
-        case '<':
-            return action::move_left;
-        case '>':
-            return action::move_right;
-        case '+':
-            return action::increment;
-        case '-':
-            return action::decrement;
-        case '!':
-            return action::start_of_input;
-        case '#':
-            return action::memory_dump;
-        default:
-            return action::invalid;
-        }
+        return to_action(*c);
     }
 
     std::optional<char> next()
     {
         char c;
 
-        if (file_stream_)
+        if (!source_->get(c))
         {
-            if (!file_stream_->get(c))
+            if (file_stream_)
             {
                 file_stream_->close();
-                return std::nullopt;
-            }
-        }
-        else
-        {
-            std::cin.get(c);
-            if (std::cin.fail())
-            {
-                return std::nullopt;
             }
+
+            return std::nullopt;
         }
 
         return c;
     }
 
     std::unique_ptr<std::ifstream> file_stream_;
+    std::istream *source_;  // file stream, stdin or whatever was given
+    bool separated_input_; // stdin holds code and input separated by '!'
+
 }; // namespace bf
 } // namespace bf
\ No newline at end of file
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace bf
+{
+//      Wire format used between server and client over a unix socket:
+// every message is a frame of 1 byte type, 4 byte payload length and the payload.
+// numbers are in native byte order as both ends live on the same machine.
+//
+// load     program source. answered with id (u64 picked by the server) or error (i32 compile error code)
+// run      run_header followed by input bytes. answered with any number of output frames and
+//          then exit (i32 exit code) or with unknown if the program is not (or no longer) cached
+enum class frame_type : char
+{
+    load = 'L',
+    run = 'R',
+    id = 'I',
+    output = 'O',
+    exit = 'X',
+    error = 'E',
+    unknown = 'U'
+};
+
+struct run_header
+{
+    uint64_t id;
+    uint64_t max_ops;    // 0 for no limit
+    uint64_t max_output; // 0 for no limit
+};
+
+struct frame
+{
+    frame_type type;
+    std::string payload;
+};
+
+inline constexpr uint32_t MaxFramePayload = 64 * 1024 * 1024;
+
+inline bool write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        auto sent = send(fd, data, size, MSG_NOSIGNAL); // a gone peer is an error, not a signal
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+inline bool read_all(int fd, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        auto got = recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (got <= 0)
+        {
+            return false;
+        }
+
+        data += got;
+        size -= got;
+    }
+
+    return true;
+}
+
+inline bool write_frame(int fd, frame_type type, std::string_view payload)
+{
+    std::array<char, 1 + sizeof(uint32_t)> header{static_cast<char>(type)};
+    auto size = static_cast<uint32_t>(payload.size());
+    std::memcpy(header.data() + 1, &size, sizeof(size));
+
+    return write_all(fd, header.data(), header.size()) && write_all(fd, payload.data(), payload.size());
+}
+
+// sends a fixed size value as the whole payload
+template <typename V> bool write_value(int fd, frame_type type, const V &value)
+{
+    return write_frame(fd, type, std::string_view{reinterpret_cast<const char *>(&value), sizeof(value)});
+}
+
+inline std::optional<frame> read_frame(int fd)
+{
+    std::array<char, 1 + sizeof(uint32_t)> header{};
+    if (!read_all(fd, header.data(), header.size()))
+    {
+        return std::nullopt;
+    }
+
+    uint32_t size{};
+    std::memcpy(&size, header.data() + 1, sizeof(size));
+    if (size > MaxFramePayload)
+    {
+        return std::nullopt;
+    }
+
+    frame f{static_cast<frame_type>(header[0]), std::string(size, '\0')};
+    if (!read_all(fd, f.payload.data(), size))
+    {
+        return std::nullopt;
+    }
+
+    return f;
+}
+
+// reads a fixed size value from the start of a payload
+template <typename V> std::optional<V> payload_as(std::string_view payload)
+{
+    if (payload.size() < sizeof(V))
+    {
+        return std::nullopt;
+    }
+
+    V value{};
+    std::memcpy(&value, payload.data(), sizeof(V));
+    return value;
+}
+
+// stream buffer that sends everything written to it as output frames
+class frame_writer : public std::streambuf
+{
+  public:
+    frame_writer(int fd)
+        : fd_{fd}
+    {
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+    }
+
+    ~frame_writer() override { sync(); }
+
+  protected:
+    int_type overflow(int_type ch) override
+    {
+        if (sync() != 0)
+        {
+            return traits_type::eof();
+        }
+
+        if (!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override
+    {
+        auto size = pptr() - pbase();
+        if (size == 0)
+        {
+            return 0;
+        }
+
+        setp(buffer_.data(), buffer_.data() + buffer_.size());
+        return write_frame(fd_, frame_type::output, std::string_view{buffer_.data(), static_cast<size_t>(size)}) ? 0
+                                                                                                                : -1;
+    }
+
+  private:
+    int fd_;
+    std::array<char, 4096> buffer_;
+};
+} // namespace bf
@@ -0,0 +1,376 @@
+#pragma once
+
+#include "compiler.h"
+#include "core.h"
+#include "log.h"
+#include "memory.h"
+#include "parser.h"
+#include "protocol.h"
+#include "util.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace bf
+{
+// least recently used cache of compiled programs. programs are found by their source (a content hash is
+// only used to narrow the search, the source itself is compared) and get an id of their own for runs,
+// so colliding hashes can never make one client run another client's code
+class program_cache
+{
+    struct entry
+    {
+        uint64_t id;
+        uint64_t hash;
+        std::string source;
+        std::shared_ptr<const program> prog;
+    };
+
+  public:
+    program_cache(size_t capacity)
+        : capacity_{capacity}
+    {
+    }
+
+    std::shared_ptr<const program> get(uint64_t id)
+    {
+        std::lock_guard lock{mutex_};
+
+        auto it = by_id_.find(id);
+        if (it == by_id_.end())
+        {
+            return nullptr;
+        }
+
+        entries_.splice(entries_.begin(), entries_, it->second); // now most recently used
+        return it->second->prog;
+    }
+
+    // id of the program compiled from exactly this source if it's cached
+    std::optional<uint64_t> find(std::string_view source)
+    {
+        std::lock_guard lock{mutex_};
+
+        auto it = find_source(source);
+        if (it == entries_.end())
+        {
+            return std::nullopt;
+        }
+
+        entries_.splice(entries_.begin(), entries_, it);
+        return it->id;
+    }
+
+    // caches a program and returns its id
+    uint64_t put(std::string source, std::shared_ptr<const program> prog)
+    {
+        std::lock_guard lock{mutex_};
+
+        if (auto it = find_source(source); it != entries_.end())
+        {
+            return it->id; // someone compiled the same program in the meantime
+        }
+
+        auto hash = util::fnv1a(source);
+        entries_.push_front(entry{next_id_++, hash, std::move(source), std::move(prog)});
+        by_id_[entries_.front().id] = entries_.begin();
+        by_hash_.emplace(hash, entries_.begin());
+
+        if (entries_.size() > capacity_)
+        {
+            auto last = std::prev(entries_.end());
+            auto [first, end] = by_hash_.equal_range(last->hash);
+            by_hash_.erase(std::find_if(first, end, [&](auto &it) { return it.second == last; }));
+            by_id_.erase(last->id);
+            entries_.pop_back(); // runs still holding it keep it alive
+        }
+
+        return entries_.front().id;
+    }
+
+  private:
+    using iterator = std::list<entry>::iterator;
+
+    iterator find_source(std::string_view source)
+    {
+        auto [first, end] = by_hash_.equal_range(util::fnv1a(source));
+        auto it = std::find_if(first, end, [&](auto &it) { return it.second->source == source; });
+        return it == end ? entries_.end() : it->second;
+    }
+
+    std::mutex mutex_;
+    size_t capacity_;
+    uint64_t next_id_{1};
+
+    std::list<entry> entries_; // most recently used first
+    std::unordered_map<uint64_t, iterator> by_id_;
+    std::unordered_multimap<uint64_t, iterator> by_hash_;
+};
+
+// serves program runs over a unix socket (see protocol.h) so that process startup, memory allocation
+// and compilation are paid once instead of on every run.
+// every connection gets a thread that only reads its requests. loading and running them is done by the
+// worker pool so connected but idle clients don't keep workers from doing anything else.
+template <typename T> class server
+{
+  public:
+    using core_t = core<T>;
+    using memory_t = memory<T>;
+    using parser_t = parser<T>;
+
+    server(std::string_view socket_path, uint64_t cells, uint64_t start_cell, bool elastic, bool wrapping,
+           unsigned workers, limits lim = {}, size_t cache_size = 128)
+        : socket_path_{socket_path}
+        , cells_{cells}
+        , start_cell_{start_cell}
+        , elastic_{elastic}
+        , wrapping_{wrapping}
+        , workers_{std::max(workers, 1u)}
+        , limits_{lim}
+        , cache_{cache_size}
+    {
+    }
+
+    // accepts connections until the process is killed
+    int listen()
+    {
+        sockaddr_un addr{};
+        if (socket_path_.size() >= sizeof(addr.sun_path))
+        {
+            logger::instance().fatal("socket path '{}' is too long.", socket_path_);
+            return 1;
+        }
+
+        // only ever replace a stale socket, never some other file
+        struct stat st
+        {
+        };
+        if (lstat(socket_path_.c_str(), &st) == 0)
+        {
+            if (!S_ISSOCK(st.st_mode))
+            {
+                logger::instance().fatal("'{}' exists and is not a socket.", socket_path_);
+                return 1;
+            }
+
+            unlink(socket_path_.c_str());
+        }
+
+        auto fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            logger::instance().fatal("could not create socket: {}", std::strerror(errno));
+            return 1;
+        }
+
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, socket_path_.c_str(), sizeof(addr.sun_path) - 1);
+
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(fd, 128) != 0)
+        {
+            logger::instance().fatal("could not listen on '{}': {}", socket_path_, std::strerror(errno));
+            close(fd);
+            return 1;
+        }
+
+        logger::instance().info("serving on '{}' with {} workers", socket_path_, workers_);
+
+        std::vector<std::thread> threads;
+        for (auto i = 0u; i < workers_; ++i)
+        {
+            threads.emplace_back([this] { work(); });
+        }
+
+        while (true)
+        {
+            auto conn = accept(fd, nullptr, nullptr);
+            if (conn < 0)
+            {
+                if (errno != EINTR)
+                {
+                    logger::instance().info("accept failed: {}", std::strerror(errno));
+                }
+                continue;
+            }
+
+            // the server runs until killed so connection threads are never joined
+            std::thread{[this, conn] {
+                serve(conn);
+                close(conn);
+            }}.detach();
+        }
+    }
+
+  private:
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock lock{mutex_};
+                ready_.wait(lock, [this] { return !pending_.empty(); });
+
+                job = std::move(pending_.front());
+                pending_.pop_front();
+            }
+
+            job();
+        }
+    }
+
+    // reads requests on one connection until the client hangs up or misbehaves. each request is handled
+    // by a worker while this thread waits for it so replies go out in order
+    void serve(int conn)
+    {
+        while (auto f = read_frame(conn))
+        {
+            // shared with the job so the worker never touches a promise this thread already dropped
+            auto done = std::make_shared<std::promise<bool>>();
+            auto ok = done->get_future();
+            {
+                std::lock_guard lock{mutex_};
+                pending_.push_back([this, conn, &f, done] { done->set_value(handle(conn, *f)); });
+            }
+            ready_.notify_one();
+
+            if (!ok.get())
+            {
+                return;
+            }
+        }
+    }
+
+    bool handle(int conn, frame &f)
+    {
+        switch (f.type)
+        {
+        case frame_type::load:
+            return load(conn, f.payload);
+        case frame_type::run:
+            return run(conn, f.payload);
+        default:
+            logger::instance().info("unexpected frame '{}'", static_cast<char>(f.type));
+            return false;
+        }
+    }
+
+    bool load(int conn, std::string &source)
+    {
+        auto id = cache_.find(source);
+
+        if (!id)
+        {
+            std::istringstream code{source};
+            std::vector<action> actions;
+            parser_t{code}.parse([&](auto, auto act) {
+                actions.push_back(act);
+                return 0;
+            });
+
+            compiler comp;
+            auto err = comp.compile(actions);
+            if (err != 0)
+            {
+                return write_value(conn, frame_type::error, int32_t{err});
+            }
+
+            id = cache_.put(std::move(source), comp.result());
+        }
+
+        return write_value(conn, frame_type::id, *id);
+    }
+
+    bool run(int conn, std::string &payload)
+    {
+        auto header = payload_as<run_header>(payload);
+        if (!header)
+        {
+            return false;
+        }
+
+        auto prog = cache_.get(header->id);
+        if (!prog)
+        {
+            return write_frame(conn, frame_type::unknown, std::string_view{});
+        }
+
+        // clients can only ask for less than the server allows
+        auto lim = limits_;
+        if (header->max_ops != 0)
+        {
+            lim.ops = std::min(lim.ops, header->max_ops);
+        }
+        if (header->max_output != 0)
+        {
+            lim.output = std::min(lim.output, header->max_output);
+        }
+
+        std::istringstream input{payload.substr(sizeof(run_header))};
+        frame_writer writer{conn};
+        std::ostream output{&writer};
+
+        core_t c{std::move(prog), acquire(), input, output, lim};
+        int32_t code = c.execute();
+        release(c.take_memory());
+
+        return output.flush() && write_value(conn, frame_type::exit, code);
+    }
+
+    // memory is pooled so runs don't pay for allocating and faulting in a fresh tape
+    memory_t acquire()
+    {
+        {
+            std::lock_guard lock{mutex_};
+            if (!pool_.empty())
+            {
+                auto mem = std::move(pool_.back());
+                pool_.pop_back();
+                return mem;
+            }
+        }
+
+        return memory_t{cells_, start_cell_, elastic_, wrapping_};
+    }
+
+    void release(memory_t &&mem)
+    {
+        mem.reset();
+
+        std::lock_guard lock{mutex_};
+        pool_.push_back(std::move(mem));
+    }
+
+    std::string socket_path_;
+    uint64_t cells_;
+    uint64_t start_cell_;
+    bool elastic_;
+    bool wrapping_;
+    unsigned workers_;
+    limits limits_; // for every run. requests can only lower them
+
+    program_cache cache_;
+
+    std::mutex mutex_; // guards pending requests and the memory pool
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> pending_;
+    std::vector<memory_t> pool_;
+};
+} // namespace bf
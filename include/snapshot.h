@@ -0,0 +1,233 @@
+#pragma once
+
+#include "log.h"
+#include "memory.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace bf
+{
+// binary memory snapshots as an alternative to printing the memory dump on every '#'.
+// taking a snapshot only copies the dump window into a preallocated buffer. full buffers are written
+// to the file by a background thread and the rest on close (or exit). print() renders a snapshot file
+// in the same format memory<T>::dump uses.
+//
+// file format (native byte order): file_header, then per snapshot a record_header followed by
+// count cells of cell_size bytes each
+class snapshots
+{
+    struct file_header
+    {
+        std::array<char, 6> magic;
+        uint8_t version;
+        uint8_t cell_size;
+    };
+
+    struct record_header
+    {
+        uint64_t cursor; // pointer position when the snapshot was taken
+        uint64_t first;  // index of the first cell in the record
+        uint64_t count;  // cells in the record
+    };
+
+    static constexpr std::array<char, 6> Magic{'b', 'F', 's', 'n', 'a', 'p'};
+    static constexpr uint8_t Version = 1;
+    static constexpr size_t BufferSize = 1 << 20; // bytes. fits thousands of 256 cell windows
+
+    snapshots() = default;
+
+  public:
+    snapshots(const snapshots &) = delete;
+    snapshots &operator=(const snapshots &) = delete;
+    snapshots(snapshots &&) = delete;
+    snapshots &operator=(snapshots &&) = delete;
+
+    ~snapshots() { close(); }
+
+    static auto &instance()
+    {
+        static snapshots s;
+        return s;
+    }
+
+    // starts writing snapshots of cell_size byte cells to path
+    bool open(const std::string &path, uint8_t cell_size)
+    {
+        path_ = path;
+        out_.open(path, std::ios::binary | std::ios::trunc);
+        file_header header{Magic, Version, cell_size};
+        if (!out_.write(reinterpret_cast<const char *>(&header), sizeof(header)))
+        {
+            logger::instance().fatal("snapshot file '{}' could not be written.", path);
+            return false;
+        }
+
+        active_.resize(BufferSize);
+        pending_.resize(BufferSize);
+        writer_ = std::thread{[this] { write(); }};
+        return true;
+    }
+
+    bool enabled() const { return writer_.joinable(); }
+
+    // copies the dump window of mem. only blocks if the writer is still busy with the previous full buffer
+    template <typename T> void take(const memory<T> &mem)
+    {
+        auto [first, count] = mem.window();
+        record_header header{mem.position(), first, count};
+        auto size = sizeof(header) + count * sizeof(T);
+
+        if (used_ + size > active_.size())
+        {
+            hand_over();
+        }
+
+        std::memcpy(active_.data() + used_, &header, sizeof(header));
+        std::memcpy(active_.data() + used_ + sizeof(header), mem.data() + first, count * sizeof(T));
+        used_ += size;
+    }
+
+    // writes everything taken so far and stops the writer. false if any snapshot could not be written
+    bool close()
+    {
+        if (!enabled())
+        {
+            return true;
+        }
+
+        hand_over();
+        {
+            std::lock_guard lock{mutex_};
+            stopping_ = true;
+        }
+        changed_.notify_all();
+
+        writer_.join();
+        out_.close();
+
+        if (failed_ || !out_)
+        {
+            logger::instance().fatal("snapshots could not be written to '{}'.", path_);
+            return false;
+        }
+
+        return true;
+    }
+
+    // renders a snapshot file like the memory dump would have looked at each '#'
+    static int print(const std::string &path, std::ostream &out)
+    {
+        std::ifstream in{path, std::ios::binary};
+        file_header header{};
+        if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != Magic ||
+            header.version != Version)
+        {
+            logger::instance().fatal("'{}' is not a snapshot file.", path);
+            return 1;
+        }
+
+        switch (header.cell_size)
+        {
+        case 1:
+            return print<int8_t>(path, in, out);
+        case 2:
+            return print<int16_t>(path, in, out);
+        case 4:
+            return print<int32_t>(path, in, out);
+        case 8:
+            return print<int64_t>(path, in, out);
+        default:
+            logger::instance().fatal("unsupported cell size in snapshot file: {} bytes", header.cell_size);
+            return 1;
+        }
+    }
+
+  private:
+    template <typename T> static int print(const std::string &path, std::istream &in, std::ostream &out)
+    {
+        std::vector<T> cells;
+        record_header record{};
+
+        while (in.read(reinterpret_cast<char *>(&record), sizeof(record)))
+        {
+            // take never writes more than a dump window so anything bigger is garbage
+            if (record.count > memory<T>::WindowSize)
+            {
+                logger::instance().fatal("'{}' is not a snapshot file.", path);
+                return 1;
+            }
+
+            cells.resize(record.count);
+            if (!in.read(reinterpret_cast<char *>(cells.data()), record.count * sizeof(T)))
+            {
+                logger::instance().fatal("snapshot file is truncated.");
+                return 1;
+            }
+
+            memory<T>::render(out, cells.data(), record.first, record.count, record.cursor);
+        }
+
+        return 0;
+    }
+
+    // passes the active buffer to the writer and continues with the one it is done with
+    void hand_over()
+    {
+        std::unique_lock lock{mutex_};
+        changed_.wait(lock, [this] { return pending_used_ == 0; });
+
+        std::swap(active_, pending_);
+        pending_used_ = used_;
+        used_ = 0;
+
+        lock.unlock();
+        changed_.notify_all();
+    }
+
+    void write()
+    {
+        std::unique_lock lock{mutex_};
+        while (true)
+        {
+            changed_.wait(lock, [this] { return stopping_ || pending_used_ != 0; });
+            if (pending_used_ == 0)
+            {
+                return; // stopping and nothing left
+            }
+
+            // the buffer is not touched by take until pending_used_ is back to 0
+            lock.unlock();
+            auto written = static_cast<bool>(out_.write(pending_.data(), pending_used_));
+            lock.lock();
+
+            failed_ = failed_ || !written; // reported on close
+
+            pending_used_ = 0;
+            changed_.notify_all();
+        }
+    }
+
+    std::string path_;
+    std::ofstream out_;
+
+    std::vector<char> active_; // filled by take on the executing thread
+    size_t used_{0};
+    std::vector<char> pending_; // being written by the writer thread
+    size_t pending_used_{0};
+
+    std::mutex mutex_; // guards pending_used_, stopping_, failed_ and the buffer swap
+    std::condition_variable changed_;
+    bool stopping_{false};
+    bool failed_{false};
+    std::thread writer_;
+};
+} // namespace bf
@@ -0,0 +1,361 @@
+#pragma once
+
+#include "compiler.h"
+#include "parser.h"
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace bf
+{
+namespace detail
+{
+// sums per offset for fold_block without allocating: scans the block once per offset it reaches
+struct scan_sums
+{
+    template <typename Walk, typename Each> static constexpr void each(Walk &&walk, Each &&cb)
+    {
+        int64_t lowest{0};
+        int64_t highest{0};
+        walk([&](int64_t offset, int64_t) {
+            lowest = offset < lowest ? offset : lowest;
+            highest = offset > highest ? offset : highest;
+        });
+
+        for (auto cell = lowest; cell <= highest; ++cell)
+        {
+            int64_t value{0};
+            walk([&](int64_t offset, int64_t delta) { value += offset == cell ? delta : 0; });
+            cb(cell, value);
+        }
+    }
+};
+
+// same front end as compiler (block folding via fold_block, isolation after input) but usable at compile
+// time. emit is called with every instruction in the order compiler would produce them.
+template <typename Emit> constexpr void compile_static(std::string_view code, Emit &&emit)
+{
+    auto block_begin = code.size();
+    auto block_end = code.size();
+
+    auto flush_block = [&] {
+        if (block_begin == code.size())
+        {
+            return;
+        }
+
+        fold_block<scan_sums>(
+            block_end - block_begin, [&](size_t i) { return to_action(code[block_begin + i]); }, emit);
+        block_begin = block_end = code.size();
+    };
+
+    auto after_input{false};
+    for (size_t i = 0; i < code.size(); ++i)
+    {
+        auto act = to_action(code[i]);
+        if (act == action::invalid)
+        {
+            continue;
+        }
+
+        auto isolated = after_input && is_block_action(act);
+        after_input = act == action::input;
+
+        if (isolated)
+        {
+            emit(isolated_instruction(act));
+        }
+        else if (is_block_action(act))
+        {
+            block_begin = block_begin == code.size() ? i : block_begin;
+            block_end = i + 1;
+        }
+        else
+        {
+            flush_block();
+            emit(instruction{act, 0, 0});
+        }
+    }
+
+    flush_block();
+    emit(instruction{action::eof, 0, 0});
+}
+
+constexpr size_t static_size(std::string_view code)
+{
+    size_t size{0};
+    compile_static(code, [&](instruction) { ++size; });
+    return size;
+}
+
+template <size_t N> struct static_program
+{
+    std::array<instruction, N> tape{};
+    std::array<uint64_t, N> targets{};
+    int error{0}; // same codes as compiler
+};
+
+template <size_t N> constexpr static_program<N> compile_static(std::string_view code)
+{
+    static_program<N> prog{};
+    size_t size{0};
+    compile_static(code, [&](instruction ins) { prog.tape[size++] = ins; });
+
+    std::array<size_t, N> loops{};
+    size_t depth{0};
+    for (size_t i = 0; i < N; ++i)
+    {
+        if (prog.tape[i].act == action::loop_start)
+        {
+            loops[depth++] = i;
+        }
+        else if (prog.tape[i].act == action::loop_end)
+        {
+            if (depth == 0)
+            {
+                prog.error = 127;
+                return prog;
+            }
+
+            auto start = loops[--depth];
+            prog.targets[i] = start;
+            prog.targets[start] = i;
+        }
+    }
+
+    if (depth != 0)
+    {
+        prog.error = 128;
+    }
+
+    return prog;
+}
+
+template <typename> inline constexpr bool dependent_false = false;
+} // namespace detail
+
+// output and exit code of a static_core run
+template <size_t MaxOutput> struct static_result
+{
+    std::array<char, MaxOutput> output{};
+    size_t size{0};
+    int code{0};
+
+    constexpr std::string_view str() const { return {output.data(), size}; }
+};
+
+// bf program known at compile time. brackets are matched and blocks are folded by the compiler and every
+// instruction becomes its own template instance, so at runtime only the specialized code is left.
+// behaves like core<T> on memory<T> with the given number of cells (not elastic) starting at cell 0.
+// the memory dump extension is not available.
+//
+//     static constexpr char hello[] = "++++++++[>++++[>++>+++>+++>+<<<<-]>+>+>->>+[<]<-]>>.>---.";
+//     auto r = bf::static_core<int8_t, hello>::run(input);   // at runtime with input
+//     constexpr auto out = bf::evaluated<int8_t, hello>;      // no input: computed by the compiler
+//
+// loops nest templates so deeply nested programs may need a higher -ftemplate-depth.
+template <typename T, const char *Code, uint64_t Cells = 30000, bool Wrapping = false> class static_core
+{
+    static constexpr std::string_view code_{Code};
+    static constexpr auto size_ = detail::static_size(code_);
+    static constexpr auto program_ = detail::compile_static<size_>(code_);
+
+    static_assert(program_.error != 127, "unmatched ']' in static bf program");
+    static_assert(program_.error != 128, "unmatched '[' in static bf program");
+    static_assert(Cells > 0, "static bf program needs at least one cell");
+
+    template <size_t MaxOutput> struct state
+    {
+        std::array<T, Cells> cells{};
+        uint64_t cell_idx{0};
+        std::string_view input{};
+        size_t input_pos{0};
+        bool skip{false}; // input hit EOF so the next instruction is skipped
+        static_result<MaxOutput> result{};
+    };
+
+  public:
+    static constexpr bool reads_input()
+    {
+        for (auto &ins : program_.tape)
+        {
+            if (ins.act == action::input)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    template <size_t MaxOutput = 1024> static constexpr static_result<MaxOutput> run(std::string_view input = {})
+    {
+        state<MaxOutput> s{};
+        s.input = input;
+
+        run_range<0, size_>(s);
+        return s.result;
+    }
+
+  private:
+    // number of instructions directly in [Begin, End). a loop counts once as its loop_start
+    template <size_t Begin, size_t End> static constexpr size_t level_size()
+    {
+        size_t size{0};
+        for (auto idx = Begin; idx < End; ++size)
+        {
+            idx = program_.tape[idx].act == action::loop_start ? program_.targets[idx] + 1 : idx + 1;
+        }
+
+        return size;
+    }
+
+    // indices of the instructions directly in [Begin, End). walking each level once like this means every
+    // instruction is instantiated exactly once, in the level it belongs to
+    template <size_t Begin, size_t End> static constexpr auto level()
+    {
+        std::array<size_t, level_size<Begin, End>()> items{};
+        auto idx = Begin;
+        for (auto &item : items)
+        {
+            item = idx;
+            idx = program_.tape[idx].act == action::loop_start ? program_.targets[idx] + 1 : idx + 1;
+        }
+
+        return items;
+    }
+
+    template <size_t Begin, size_t End> static constexpr auto level_ = level<Begin, End>();
+
+    // runs the instructions in [Begin, End). false once an error stopped the program
+    template <size_t Begin, size_t End, typename State> static constexpr bool run_range(State &s)
+    {
+        return run_items<Begin, End>(s, std::make_index_sequence<level_size<Begin, End>()>{});
+    }
+
+    template <size_t Begin, size_t End, typename State, size_t... K>
+    static constexpr bool run_items(State &s, std::index_sequence<K...>)
+    {
+        return (run_item<level_<Begin, End>[K]>(s) && ...);
+    }
+
+    template <size_t I, typename State> static constexpr bool run_item(State &s)
+    {
+        if constexpr (program_.tape[I].act == action::loop_start)
+        {
+            constexpr auto end = program_.targets[I];
+
+            // a skipped '[' enters the loop without looking at the cell like the interpreter does
+            auto enter = s.skip || s.cells[s.cell_idx] != 0;
+            s.skip = false;
+
+            if (enter)
+            {
+                do
+                {
+                    if (!run_range<I + 1, end>(s))
+                    {
+                        return false;
+                    }
+
+                    if (s.skip)
+                    {
+                        s.skip = false; // skipped ']' falls out of the loop
+                        break;
+                    }
+                } while (s.cells[s.cell_idx] != 0);
+            }
+
+            return true;
+        }
+        else
+        {
+            if (s.skip)
+            {
+                s.skip = false;
+                return true;
+            }
+
+            return step<I>(s);
+        }
+    }
+
+    template <size_t I, typename State> static constexpr bool step(State &s)
+    {
+        constexpr auto ins = program_.tape[I];
+
+        if constexpr (ins.act == action::increment)
+        {
+            uint64_t idx{};
+            if (!locate(s, ins.offset, idx))
+            {
+                return false;
+            }
+
+            s.cells[idx] += static_cast<T>(ins.arg);
+        }
+        else if constexpr (ins.act == action::move_right)
+        {
+            return locate(s, ins.arg, s.cell_idx);
+        }
+        else if constexpr (ins.act == action::output)
+        {
+            if (s.result.size == s.result.output.size())
+            {
+                s.result.code = 133; // same as exceeding the output limit
+                return false;
+            }
+
+            s.result.output[s.result.size++] = static_cast<char>(s.cells[s.cell_idx]);
+        }
+        else if constexpr (ins.act == action::input)
+        {
+            if (s.input_pos >= s.input.size())
+            {
+                s.skip = true;
+                return true;
+            }
+
+            auto c = s.input[s.input_pos++];
+            s.cells[s.cell_idx] = (c == '\n' || c == '\r') ? T{10} : T(c);
+        }
+        else if constexpr (ins.act == action::memory_dump)
+        {
+            static_assert(detail::dependent_false<State>, "memory dump is not available in static bf programs");
+        }
+
+        return true;
+    }
+
+    // same bounds handling as memory<T>::locate without elastic growth
+    template <typename State> static constexpr bool locate(State &s, int64_t offset, uint64_t &idx)
+    {
+        auto target = static_cast<int64_t>(s.cell_idx) + offset;
+        if (target >= 0 && static_cast<uint64_t>(target) < Cells)
+        {
+            idx = target;
+            return true;
+        }
+
+        if (target < 0 && Wrapping)
+        {
+            auto capacity = static_cast<int64_t>(Cells);
+            idx = (target % capacity + capacity) % capacity;
+            return true;
+        }
+
+        s.result.code = target < 0 ? 131 : 130;
+        return false;
+    }
+};
+
+// output of a program that takes no input, computed entirely by the compiler
+template <typename T, const char *Code, size_t MaxOutput = 1024>
+inline constexpr auto evaluated = []() {
+    static_assert(!static_core<T, Code>::reads_input(), "only programs without input can be evaluated statically");
+    return static_core<T, Code>::template run<MaxOutput>();
+}();
+} // namespace bf
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "log.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <fmt/format.h>
+#include <optional>
+#include <string>
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bf
+{
+enum class phase : int
+{
+    parse = 0,
+    compile,
+    run
+};
+
+// collects hardware counters (via perf_event_open on linux), timing per phase and executed instruction counts.
+// when perf counters are not available (e.g. in containers) only timing and getrusage data is reported.
+class stats
+{
+  public:
+    enum class format
+    {
+        none,
+        table,
+        json
+    };
+
+  private:
+    static constexpr auto PhaseCount = 3;
+    static constexpr auto CounterCount = 5;
+    static constexpr auto PageFaults = CounterCount - 1; // falls back to getrusage
+
+    static constexpr std::array<const char *, PhaseCount> PhaseNames{"parse", "compile", "run"};
+    static constexpr std::array<const char *, CounterCount> CounterNames{"cycles", "instructions", "branch_misses",
+                                                                         "l1d_misses", "page_faults"};
+
+    struct sample
+    {
+        std::chrono::steady_clock::time_point wall;
+        int64_t cpu_us;
+        std::array<uint64_t, CounterCount> counters;
+    };
+
+    struct totals
+    {
+        bool measured{false};
+        uint64_t wall_ns{0};
+        int64_t cpu_us{0};
+        std::array<uint64_t, CounterCount> counters{};
+    };
+
+    stats()
+    {
+        fds_.fill(-1);
+    }
+
+  public:
+    stats(const stats &) = delete;
+    stats &operator=(const stats &) = delete;
+    stats(stats &&) = delete;
+    stats &operator=(stats &&) = delete;
+
+    ~stats()
+    {
+#ifdef __linux__
+        for (auto fd : fds_)
+        {
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    static auto &instance()
+    {
+        static stats s;
+        return s;
+    }
+
+    // measures everything from construction till destruction as part of given phase
+    class scope
+    {
+      public:
+        scope(stats &owner, phase p)
+            : owner_{owner}
+            , phase_{p}
+        {
+            if (owner_.enabled())
+            {
+                start_ = owner_.now();
+            }
+        }
+
+        scope(const scope &) = delete;
+        scope &operator=(const scope &) = delete;
+
+        ~scope()
+        {
+            if (start_)
+            {
+                owner_.accumulate(phase_, *start_, owner_.now());
+            }
+        }
+
+      private:
+        stats &owner_;
+        phase phase_;
+        std::optional<sample> start_;
+    };
+
+    void enable(format fmt)
+    {
+        format_ = fmt;
+        if (enabled())
+        {
+            open_counters();
+        }
+    }
+
+    bool enabled() const { return format_ != format::none; }
+
+    scope measure(phase p) { return scope{*this, p}; }
+
+    void count(uint64_t executed_instructions, uint64_t input_bytes, uint64_t output_bytes)
+    {
+        if (!enabled())
+        {
+            return;
+        }
+
+        executed_instructions_ += executed_instructions;
+        input_bytes_ += input_bytes;
+        output_bytes_ += output_bytes;
+    }
+
+    void report() const
+    {
+        std::fflush(stdout); // keep program output ahead of the report
+
+        if (format_ == format::table)
+        {
+            report_table();
+        }
+        else if (format_ == format::json)
+        {
+            report_json();
+        }
+    }
+
+  private:
+    void open_counters()
+    {
+#ifdef __linux__
+        constexpr std::array<std::pair<uint32_t, uint64_t>, CounterCount> events{{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+        }};
+
+        for (auto i = 0; i < CounterCount; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.exclude_kernel = 1; // allows counting with perf_event_paranoid up to 2
+            attr.exclude_hv = 1;
+            attr.inherit = 1; // include threads started later (nest groups, snapshot writer)
+
+            fds_[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fds_[i] == -1)
+            {
+                logger::instance().info("perf counter '{}' not available", CounterNames[i]);
+            }
+        }
+#endif
+    }
+
+    bool available(int counter) const { return fds_[counter] != -1 || counter == PageFaults; }
+
+    bool any_available() const
+    {
+        for (auto i = 0; i < PageFaults; ++i)
+        {
+            if (available(i))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    sample now() const
+    {
+        sample s{};
+
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        s.cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec +
+                   usage.ru_stime.tv_usec;
+        s.counters[PageFaults] = usage.ru_minflt + usage.ru_majflt;
+
+#ifdef __linux__
+        for (auto i = 0; i < CounterCount; ++i)
+        {
+            uint64_t value{};
+            if (fds_[i] != -1 && read(fds_[i], &value, sizeof(value)) == sizeof(value))
+            {
+                s.counters[i] = value;
+            }
+        }
+#endif
+
+        s.wall = std::chrono::steady_clock::now(); // last so reading counters is not part of the phase
+        return s;
+    }
+
+    void accumulate(phase p, const sample &from, const sample &to)
+    {
+        auto &t = phases_[static_cast<int>(p)];
+
+        t.measured = true;
+        t.wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(to.wall - from.wall).count();
+        t.cpu_us += to.cpu_us - from.cpu_us;
+
+        for (auto i = 0; i < CounterCount; ++i)
+        {
+            t.counters[i] += to.counters[i] - from.counters[i];
+        }
+    }
+
+    void report_table() const
+    {
+        fmt::print(stderr, "\n{:<8} {:>12} {:>12}", "phase", "wall ms", "cpu ms");
+        for (auto i = 0; i < CounterCount; ++i)
+        {
+            fmt::print(stderr, " {:>14}", CounterNames[i]);
+        }
+        fmt::print(stderr, "\n");
+
+        for (auto p = 0; p < PhaseCount; ++p)
+        {
+            auto &t = phases_[p];
+            if (!t.measured)
+            {
+                continue; // e.g. parse and compile are part of run in pipelined mode
+            }
+
+            fmt::print(stderr, "{:<8} {:>12.3f} {:>12.3f}", PhaseNames[p], t.wall_ns / 1e6, t.cpu_us / 1e3);
+            for (auto i = 0; i < CounterCount; ++i)
+            {
+                if (available(i))
+                {
+                    fmt::print(stderr, " {:>14}", t.counters[i]);
+                }
+                else
+                {
+                    fmt::print(stderr, " {:>14}", "n/a");
+                }
+            }
+            fmt::print(stderr, "\n");
+        }
+
+        if (!any_available())
+        {
+            fmt::print(stderr, "(hardware counters not available, page faults from getrusage)\n");
+        }
+
+        fmt::print(stderr, "executed instructions: {}\ninput bytes: {}\noutput bytes: {}\n", executed_instructions_,
+                   input_bytes_, output_bytes_);
+    }
+
+    void report_json() const
+    {
+        std::string out{"{\"counters\":"};
+        out += any_available() ? "\"perf_event\"" : "\"rusage\"";
+        out += ",\"phases\":{";
+
+        auto first{true};
+        for (auto p = 0; p < PhaseCount; ++p)
+        {
+            auto &t = phases_[p];
+            if (!t.measured)
+            {
+                continue;
+            }
+
+            out += fmt::format("{}\"{}\":{{\"wall_ns\":{},\"cpu_us\":{}", first ? "" : ",", PhaseNames[p], t.wall_ns,
+                               t.cpu_us);
+            for (auto i = 0; i < CounterCount; ++i)
+            {
+                if (available(i))
+                {
+                    out += fmt::format(",\"{}\":{}", CounterNames[i], t.counters[i]);
+                }
+                else
+                {
+                    out += fmt::format(",\"{}\":null", CounterNames[i]);
+                }
+            }
+            out += "}";
+            first = false;
+        }
+
+        out += fmt::format("}},\"executed_instructions\":{},\"input_bytes\":{},\"output_bytes\":{}}}",
+                           executed_instructions_, input_bytes_, output_bytes_);
+        fmt::print(stderr, "{}\n", out);
+    }
+
+    format format_{format::none};
+    std::array<int, CounterCount> fds_;
+    std::array<totals, PhaseCount> phases_{};
+
+    uint64_t executed_instructions_{0}; // compiled ones. a folded block of +-<> counts once per add and move
+    uint64_t input_bytes_{0};
+    uint64_t output_bytes_{0};
+};
+} // namespace bf
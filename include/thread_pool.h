@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bf
+{
+// small fixed size pool. threads are only started once the pool is first used
+class thread_pool
+{
+  private:
+    thread_pool()
+        : size_{std::clamp(std::thread::hardware_concurrency(), 1u, 4u) - 1} // the caller works too
+    {
+    }
+
+  public:
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+    thread_pool(thread_pool &&) = delete;
+    thread_pool &operator=(thread_pool &&) = delete;
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard lock{mutex_};
+            stopping_ = true;
+        }
+        ready_.notify_all();
+
+        for (auto &t : threads_)
+        {
+            t.join();
+        }
+    }
+
+    static auto &instance()
+    {
+        static thread_pool pool;
+        return pool;
+    }
+
+    // runs all tasks and returns once every one of them finished. the calling thread runs tasks as well
+    void run_all(std::vector<std::function<void()>> &tasks)
+    {
+        std::mutex done_mutex;
+        std::condition_variable done;
+        auto remaining = tasks.size();
+
+        auto finished = [&] {
+            std::lock_guard lock{done_mutex};
+            if (--remaining == 0)
+            {
+                done.notify_one();
+            }
+        };
+
+        {
+            std::lock_guard lock{mutex_};
+            start();
+
+            for (auto i = 1u; i < tasks.size(); ++i)
+            {
+                queue_.push_back([&, i] {
+                    tasks[i]();
+                    finished();
+                });
+            }
+        }
+        ready_.notify_all();
+
+        tasks.front()();
+        finished();
+
+        // help out instead of just waiting
+        while (auto task = take())
+        {
+            task();
+        }
+
+        std::unique_lock lock{done_mutex};
+        done.wait(lock, [&] { return remaining == 0; });
+    }
+
+  private:
+    void start()
+    {
+        while (threads_.size() < size_)
+        {
+            threads_.emplace_back([this] { work(); });
+        }
+    }
+
+    std::function<void()> take()
+    {
+        std::lock_guard lock{mutex_};
+        if (queue_.empty())
+        {
+            return {};
+        }
+
+        auto task = std::move(queue_.front());
+        queue_.pop_front();
+        return task;
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock{mutex_};
+                ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+
+                if (queue_.empty())
+                {
+                    return; // stopping
+                }
+
+                task = std::move(queue_.front());
+                queue_.pop_front();
+            }
+
+            task();
+        }
+    }
+
+    unsigned size_;
+    bool stopping_{false};
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()>> queue_;
+    std::vector<std::thread> threads_;
+};
+} // namespace bf
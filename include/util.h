@@ -4,6 +4,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <string_view>
 
 namespace util
 {
@@ -40,4 +41,17 @@ template <typename T> static decltype(auto) bold_underline(T data)
 {
     return std::string("\u001b[1m\u001b[4m") + data + "\u001b[0m";
 }
+
+// 64 bit FNV-1a. stable across runs so it can be used as content id
+static constexpr uint64_t fnv1a(std::string_view data)
+{
+    uint64_t hash{0xcbf29ce484222325ull};
+    for (auto c : data)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
 } // namespace util
\ No newline at end of file
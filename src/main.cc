@@ -1,11 +1,17 @@
+#include "client.h"
 #include "config.h"
 #include "core.h"
 #include "log.h"
+#include "server.h"
+#include "snapshot.h"
+#include "stats.h"
 #include "util.h"
 #include <cxxopts.hpp>
 
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <thread>
 
 using namespace std;
 using namespace bf;
@@ -44,8 +50,17 @@ int main(int argc, char *argv[])
     uint64_t start_cell{0};
     auto elastic{false};
     auto wrapping{false};
+    auto pipelined{false};
     string file{};
     auto logging{false};
+    string stats_format{};
+    string serve_socket{};
+    string connect_socket{};
+    string snapshot_file{};
+    string print_file{};
+    unsigned workers{std::max(std::thread::hardware_concurrency(), 1u)};
+    uint64_t max_ops{0};
+    uint64_t max_output{0};
 
     try
     {
@@ -57,6 +72,15 @@ int main(int argc, char *argv[])
             ("i,start-cell", "Cell index for start cell", cxxopts::value<uint64_t>(start_cell))
             ("e,elastic", "Infinite array of cells", cxxopts::value<bool>(elastic))
             ("w,wrapping", "Wrap on out of bounds", cxxopts::value<bool>(wrapping))
+            ("p,pipelined", "Start executing code while it's still being read", cxxopts::value<bool>(pipelined))
+            ("stats", "Print performance counters per phase on exit (table or json)", cxxopts::value<std::string>(stats_format)->implicit_value("table"), "format")
+            ("max-ops", "Stop after executing this many instructions (0 is no limit)", cxxopts::value<uint64_t>(max_ops))
+            ("max-output", "Stop after printing this many bytes (0 is no limit)", cxxopts::value<uint64_t>(max_output))
+            ("serve", "Serve runs on given unix socket until killed", cxxopts::value<std::string>(serve_socket), "socket")
+            ("workers", "Worker threads for --serve", cxxopts::value<unsigned>(workers))
+            ("connect", "Run the program on a server started with --serve", cxxopts::value<std::string>(connect_socket), "socket")
+            ("snapshot", "Write memory dumps (#) as binary snapshots to file instead of printing them", cxxopts::value<std::string>(snapshot_file), "file")
+            ("print-snapshots", "Print memory dumps from a file written by --snapshot and exit", cxxopts::value<std::string>(print_file), "file")
             ("input", "Input file (can also be specified as first argument)", cxxopts::value<std::string>(), "filename")        
             ("h,help", "Help message")
         ;
@@ -96,17 +120,113 @@ int main(int argc, char *argv[])
 
     logger::instance().enable(logging);
 
+    if (stats_format == "table")
+    {
+        stats::instance().enable(stats::format::table);
+    }
+    else if (stats_format == "json")
+    {
+        stats::instance().enable(stats::format::json);
+    }
+    else if (!stats_format.empty())
+    {
+        logger::instance().fatal("invalid stats format '{}'. supported: table json", stats_format);
+        return 1;
+    }
+
+    if (!print_file.empty())
+    {
+        return snapshots::print(print_file, std::cout);
+    }
+
+    if (!serve_socket.empty() && stats::instance().enabled())
+    {
+        logger::instance().fatal("--stats can not be used with --serve");
+        return 1;
+    }
+
+    if (!serve_socket.empty() && !snapshot_file.empty())
+    {
+        logger::instance().fatal("--snapshot can not be used with --serve");
+        return 1;
+    }
+
+    limits lim{};
+    if (max_ops != 0)
+    {
+        lim.ops = max_ops;
+    }
+    if (max_output != 0)
+    {
+        lim.output = max_output;
+    }
+
+    if (!connect_socket.empty())
+    {
+        // the program runs remotely. with no file stdin holds code and input separated by '!' like always
+        std::string source{std::istreambuf_iterator<char>{std::cin}, {}};
+        std::string input{};
+
+        if (!file.empty())
+        {
+            std::ifstream code{file};
+            if (!code)
+            {
+                logger::instance().fatal("input file '{}' could not be read.", file);
+                return -1;
+            }
+
+            input = std::move(source);
+            source.assign(std::istreambuf_iterator<char>{code}, {});
+        }
+        else if (auto separator = source.find('!'); separator != std::string::npos)
+        {
+            input = source.substr(separator + 1);
+            source.resize(separator);
+        }
+
+        return client{connect_socket}.execute(source, input, lim);
+    }
+
+    // same for all cell sizes
+    auto launch = [&](auto cell) {
+        using cell_t = decltype(cell);
+
+        if (!serve_socket.empty())
+        {
+            return server<cell_t>{serve_socket, stack_size, start_cell, elastic, wrapping, workers, lim}.listen();
+        }
+
+        if (!snapshot_file.empty() && !snapshots::instance().open(snapshot_file, sizeof(cell_t)))
+        {
+            return 1;
+        }
+
+        core<cell_t> c{file, stack_size, start_cell, elastic, wrapping, pipelined, lim};
+        auto code = c.execute();
+        if (!snapshots::instance().close() && code == 0)
+        {
+            code = 1; // the program ran fine but its memory dumps are lost
+        }
+
+        auto &counts = c.counts();
+        stats::instance().count(counts.instructions, counts.input_bytes, counts.output_bytes);
+        stats::instance().report();
+        return code;
+    };
+
     logger::instance().info("stack size: {} cells", stack_size);
     logger::instance().info("start at cell: {}", start_cell);
     logger::instance().info("elastic memory: {}", elastic ? "yes" : "no");
     logger::instance().info("wrapping: {}", wrapping ? "yes" : "no");
+    logger::instance().info("pipelined: {}", pipelined ? "yes" : "no");
 
     if constexpr (bf::Enable8)
     {
         if (cell_size <= 8)
         {
             logger::instance().info("cell size: 8 bit");
-            return core<int8_t>{file, stack_size, start_cell, elastic, wrapping}.execute();
+            return launch(int8_t{});
         }
     }
 
@@ -115,7 +235,7 @@ int main(int argc, char *argv[])
         if (cell_size <= 16)
         {
             logger::instance().info("cell size: 16 bit");
-            return core<int16_t>{file, stack_size, start_cell, elastic, wrapping}.execute();
+            return launch(int16_t{});
         }
     }
 
@@ -124,7 +244,7 @@ int main(int argc, char *argv[])
         if (cell_size <= 32)
         {
             logger::instance().info("cell size: 32 bit");
-            return core<int32_t>{file, stack_size, start_cell, elastic, wrapping}.execute();
+            return launch(int32_t{});
         }
     }
 
@@ -133,7 +253,7 @@ int main(int argc, char *argv[])
         if (cell_size <= 64)
         {
             logger::instance().info("cell size: 64 bit");
-            return core<int64_t>{file, stack_size, start_cell, elastic, wrapping}.execute();
+            return launch(int64_t{});
         }
     }
 